@@ -0,0 +1,327 @@
+#ifndef APPROXIMATE_HEADER
+#define APPROXIMATE_HEADER
+
+#include <string_view>
+#include <vector>
+#include <map>
+#include <stack>
+#include <optional>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdint>
+
+#include "fsm.hpp"
+#include "parser.hpp"
+
+/**
+ * Matching that tolerates up to k edits, i.e. inserted, deleted or
+ * substituted bytes (the Levenshtein distance over bytes).
+ */
+namespace approximate {
+
+struct match
+{
+    /** The end of the match in the input. */
+    std::size_t end;
+    /** The fewest edits with which the match ends there. */
+    int errors;
+};
+
+/**
+ * Simulates a small regex with up to k errors bit-parallel (after Wu and
+ * Manber, "Fast Text Searching Allowing Errors"). The regex is turned into
+ * its position automaton, in which each state is a position of the regex
+ * (one of its labeled NFA transitions, or all the bytes a class may have at
+ * one point, e.g. those of `[a-z]`) and is entered on a set of inputs, so
+ * a set of states fits in a machine word and a transition on an input is
+ * the set of the states following the current ones masked by the states
+ * entered on that input. One such set is kept per number of errors, and
+ * edits move states from one level to the next, so the input is matched
+ * in O(n * k) time. Regexes may have up to 63 positions.
+ */
+class matcher
+{
+    using mask_type = std::uint64_t;
+    static constexpr int max_positions = 63;
+    // Bit 0 is the start state, which is entered on no input.
+    static constexpr mask_type start_bit = 1;
+
+    // The states entered on each input.
+    std::vector<mask_type> input_masks_;
+    // The states that follow any of the states in each byte of a mask, by
+    // the byte's index and value, so that the follow set of a whole mask is
+    // the union of a lookup per byte.
+    std::vector<mask_type> follow_tables_;
+    int num_mask_bytes_;
+    mask_type final_mask_ = 0;
+    int max_errors_;
+    fsm::match_mode mode_;
+
+public:
+    /**
+     * In full match mode the whole input, in prefix mode a prefix of it and
+     * in search mode a substring of it must be within `max_errors` edits of
+     * a string matched by `regex`.
+     */
+    matcher(std::string_view regex, const int max_errors,
+        const fsm::match_mode mode = fsm::match_mode::search)
+        : input_masks_(fsm::frozen_dfa::alphabet_size, 0)
+        , max_errors_(max_errors)
+        , mode_(mode)
+    {
+        if(max_errors_ < 0) {
+            throw std::invalid_argument("the number of errors must not be negative");
+        }
+        const auto nfa = parser::shunting_yard_nfa_parser(regex).parse();
+        const auto& table = nfa.transition_table();
+        struct transition { fsm::state_t from; fsm::state_t to; unsigned char input; };
+        std::vector<transition> transitions;
+        std::vector<std::vector<fsm::state_t>> epsilon_transitions(nfa.size());
+        // Whether a state has labeled transitions or is final, i.e. whether
+        // reaching it matters.
+        std::vector<char> is_important(nfa.size(), false);
+        is_important[nfa.final_state()] = true;
+        for(fsm::state_t from = 0; from < nfa.size(); ++from) {
+            for(fsm::state_t to = 0; to < nfa.size(); ++to) {
+                const auto input = table[from][to];
+                if(from == to || input == 0) { continue; }
+                if(input == fsm::epsilon) {
+                    epsilon_transitions[from].push_back(to);
+                } else {
+                    transitions.push_back({from, to, static_cast<unsigned char>(input)});
+                    is_important[from] = true;
+                }
+            }
+        }
+        // The important states in the epsilon closure of each state that is
+        // entered on an input, or is the start state, by state.
+        std::map<fsm::state_t, std::vector<char>> closures;
+        const auto closure_of = [&](const fsm::state_t s) -> const std::vector<char>& {
+            const auto [it, inserted] = closures.try_emplace(s);
+            if(inserted) {
+                std::vector<char> is_reached(nfa.size(), false);
+                std::vector<fsm::state_t> to_visit{s};
+                is_reached[s] = true;
+                while(!to_visit.empty()) {
+                    const auto t = to_visit.back();
+                    to_visit.pop_back();
+                    for(const auto u : epsilon_transitions[t]) {
+                        if(!is_reached[u]) {
+                            is_reached[u] = true;
+                            to_visit.push_back(u);
+                        }
+                    }
+                }
+                for(auto t = 0; t < nfa.size(); ++t) {
+                    is_reached[t] = is_reached[t] && is_important[t];
+                }
+                it->second = std::move(is_reached);
+            }
+            return it->second;
+        };
+        closure_of(nfa.start_state());
+        for(const auto& t : transitions) {
+            closure_of(t.to);
+        }
+
+        // Positions are numbered from 1 and `to` of the start is the NFA's
+        // start state. Transitions that are followed by the same states and
+        // that follow the same states are interchangeable but for their
+        // input, so they share a position, e.g. all the bytes of `[a-z]`.
+        struct position { fsm::state_t from; fsm::state_t to; };
+        std::vector<position> positions{{-1, nfa.start_state()}};
+        std::map<std::pair<std::vector<char>, std::vector<char>>, std::size_t> ids;
+        for(const auto& t : transitions) {
+            std::vector<char> followed(closures.size());
+            std::transform(closures.begin(), closures.end(), followed.begin(),
+                [&t](const auto& closure) { return closure.second[t.from]; });
+            const auto [it, inserted] = ids.try_emplace(
+                {std::move(followed), closures[t.to]}, positions.size());
+            if(inserted) {
+                if(positions.size() > max_positions) {
+                    throw std::invalid_argument("regex is too large for approximate matching");
+                }
+                positions.push_back({t.from, t.to});
+            }
+            input_masks_[t.input] |= mask_type(1) << it->second;
+        }
+
+        // A position is followed by the positions leaving the epsilon closure
+        // of its target.
+        std::vector<mask_type> follow(positions.size(), 0);
+        for(std::size_t p = 0; p < positions.size(); ++p) {
+            const auto& closure = closures[positions[p].to];
+            for(std::size_t q = 1; q < positions.size(); ++q) {
+                if(closure[positions[q].from]) {
+                    follow[p] |= mask_type(1) << q;
+                }
+            }
+            if(closure[nfa.final_state()]) {
+                final_mask_ |= mask_type(1) << p;
+            }
+        }
+
+        num_mask_bytes_ = (positions.size() + 7) / 8;
+        follow_tables_.resize(num_mask_bytes_ * 256, 0);
+        for(auto i = 0; i < num_mask_bytes_; ++i) {
+            for(auto byte = 0; byte < 256; ++byte) {
+                auto& f = follow_tables_[i * 256 + byte];
+                for(auto bit = 0; bit < 8; ++bit) {
+                    const std::size_t p = i * 8 + bit;
+                    if(byte & (1 << bit) && p < positions.size()) {
+                        f |= follow[p];
+                    }
+                }
+            }
+        }
+    }
+
+    int max_errors() const noexcept { return max_errors_; }
+
+    fsm::match_mode mode() const noexcept { return mode_; }
+
+    /**
+     * Returns the first end, from `offset` on, of a match with at most
+     * `max_errors()` edits, or in full match mode whether the input is such
+     * a match. Matches may only start at `offset` unless in search mode.
+     */
+    std::optional<match> find(std::string_view input, const std::size_t offset = 0) const
+    {
+        // The states reachable with at most i errors, by i.
+        std::vector<mask_type> states(max_errors_ + 1);
+        states[0] = start_bit;
+        for(auto i = 1; i <= max_errors_; ++i) {
+            // Deleting the next position of the regex.
+            states[i] = states[i - 1] | follow_of(states[i - 1]);
+        }
+
+        for(auto pos = offset;; ++pos) {
+            if(mode_ != fsm::match_mode::full || pos == input.size()) {
+                if(states[max_errors_] & final_mask_) {
+                    auto errors = 0;
+                    while(!(states[errors] & final_mask_)) { ++errors; }
+                    return match{pos, errors};
+                }
+            }
+            if(pos == input.size()) { break; }
+
+            const auto input_mask = input_masks_[static_cast<unsigned char>(input[pos])];
+            auto prev = states[0];
+            states[0] = follow_of(states[0]) & input_mask;
+            if(mode_ == fsm::match_mode::search) {
+                states[0] |= start_bit;
+            }
+            for(auto i = 1; i <= max_errors_; ++i) {
+                const auto old = states[i];
+                states[i] = (follow_of(old) & input_mask)
+                    // Having matched fewer errors.
+                    | states[i - 1]
+                    // Inserting the input.
+                    | prev
+                    // Substituting the input for the next position.
+                    | follow_of(prev)
+                    // Deleting the next position.
+                    | follow_of(states[i - 1]);
+                prev = old;
+            }
+            if(states[max_errors_] == 0) { break; }
+        }
+        return std::nullopt;
+    }
+
+    /** Returns whether there is a match, see `find`. */
+    fsm::result simulate(std::string_view input) const
+    {
+        return find(input) ? fsm::result::accept : fsm::result::reject;
+    }
+
+private:
+    mask_type follow_of(mask_type states) const noexcept
+    {
+        mask_type result = 0;
+        for(auto i = 0; i < num_mask_bytes_ && states != 0; ++i, states >>= 8) {
+            result |= follow_tables_[i * 256 + (states & 0xff)];
+        }
+        return result;
+    }
+};
+
+/**
+ * Builds a DFA that accepts the strings within `max_errors` edits of `word`,
+ * for dictionary lookups, e.g. by intersecting it with a trie. Its states
+ * are the distinct rows of the edit distance table between `word` and the
+ * input so far, with distances above `max_errors` clamped, so for a small
+ * number of errors there are few of them, and only the bytes in `word` need
+ * to be told apart from all others. In search mode, substrings of the input
+ * are matched instead, like with `matcher`.
+ */
+inline fsm::frozen_dfa levenshtein_dfa(std::string_view word, const int max_errors,
+    const fsm::match_mode mode = fsm::match_mode::full)
+{
+    if(max_errors < 0) {
+        throw std::invalid_argument("the number of errors must not be negative");
+    }
+    using row_type = std::vector<int>;
+    const int m = word.size();
+    const auto clamp = [max_errors](const int d) { return std::min(d, max_errors + 1); };
+
+    // The bytes of the word and one that stands for all others.
+    std::vector<int> inputs(word.begin(), word.end());
+    for(auto& c : inputs) {
+        c = static_cast<unsigned char>(c);
+    }
+    std::sort(inputs.begin(), inputs.end());
+    inputs.erase(std::unique(inputs.begin(), inputs.end()), inputs.end());
+    int other = 0;
+    while(std::binary_search(inputs.begin(), inputs.end(), other)) { ++other; }
+
+    std::vector<fsm::state_t> transitions(fsm::frozen_dfa::alphabet_size, fsm::frozen_dfa::dead_state);
+    std::vector<int> accepted{fsm::frozen_dfa::no_pattern};
+    std::map<row_type, fsm::state_t> ids;
+    std::stack<row_type> to_process;
+    const auto get_state = [&](row_type row) {
+        if(std::all_of(row.begin(), row.end(), [max_errors](const int d) { return d > max_errors; })) {
+            return fsm::frozen_dfa::dead_state;
+        }
+        const auto [it, inserted] = ids.try_emplace(row, ids.size() + 1);
+        if(inserted) {
+            transitions.resize(transitions.size() + fsm::frozen_dfa::alphabet_size);
+            accepted.push_back(row[m] <= max_errors ? 0 : fsm::frozen_dfa::no_pattern);
+            to_process.push(std::move(row));
+        }
+        return it->second;
+    };
+
+    row_type start(m + 1);
+    for(auto i = 0; i <= m; ++i) {
+        start[i] = clamp(i);
+    }
+    const auto start_state = get_state(start);
+
+    while(!to_process.empty()) {
+        const auto row = std::move(to_process.top());
+        to_process.pop();
+        const auto from = ids[row];
+        const auto next_state = [&](const int c) {
+            row_type next(m + 1);
+            next[0] = clamp(row[0] + 1);
+            for(auto i = 1; i <= m; ++i) {
+                const auto cost = static_cast<unsigned char>(word[i - 1]) == c ? 0 : 1;
+                next[i] = clamp(std::min({row[i - 1] + cost, row[i] + 1, next[i - 1] + 1}));
+            }
+            return get_state(std::move(next));
+        };
+        const auto other_state = next_state(other);
+        std::fill_n(&transitions[from * fsm::frozen_dfa::alphabet_size],
+            fsm::frozen_dfa::alphabet_size, other_state);
+        for(const auto c : inputs) {
+            transitions[from * fsm::frozen_dfa::alphabet_size + c] = next_state(c);
+        }
+    }
+
+    return fsm::frozen_dfa::from_table(std::move(transitions), std::move(accepted), start_state, mode);
+}
+
+} // approximate
+
+#endif
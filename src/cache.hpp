@@ -0,0 +1,259 @@
+#ifndef CACHE_HEADER
+#define CACHE_HEADER
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <cstdint>
+
+#include "regex.hpp"
+
+/**
+ * Caching of match results for inputs that repeat often, e.g. user agents or
+ * status codes, so that those are answered by a hash table lookup instead of
+ * a DFA run.
+ */
+namespace cache {
+
+/**
+ * A fast, non-cryptographic 64-bit hash that consumes 8 bytes at a time, with
+ * the final mix of MurmurHash3.
+ */
+inline std::uint64_t hash(std::string_view input) noexcept
+{
+    constexpr std::uint64_t multiplier = 0x9e3779b97f4a7c15ull;
+    std::uint64_t h = input.size() * multiplier;
+    std::size_t i = 0;
+    for(; i + 8 <= input.size(); i += 8) {
+        std::uint64_t word;
+        std::memcpy(&word, input.data() + i, 8);
+        h = (h ^ word) * multiplier;
+        h ^= h >> 32;
+    }
+    if(i < input.size()) {
+        std::uint64_t tail = 0;
+        std::memcpy(&tail, input.data() + i, input.size() - i);
+        h = (h ^ tail) * multiplier;
+    }
+
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+struct options
+{
+    /**
+     * The maximum number of cached inputs, which must be at least 2. It's
+     * rounded down to a multiple of twice the number of shards.
+     */
+    std::size_t capacity = 4096;
+    /**
+     * The number of independently locked parts of the cache, which lets
+     * threads that look up different inputs mostly avoid contention. Fewer
+     * shards are used if the capacity doesn't allow for two entries each.
+     */
+    std::size_t num_shards = 16;
+    /** Longer inputs are matched without being cached. */
+    std::size_t max_input_size = 256;
+};
+
+struct statistics
+{
+    std::uint64_t hits = 0;
+    std::uint64_t misses = 0;
+    /** Inputs that were matched without the cache, as they're too long. */
+    std::uint64_t bypasses = 0;
+
+    /** The fraction of the lookups that were hits, or 0 if there were none. */
+    double hit_ratio() const noexcept
+    {
+        const auto lookups = hits + misses + bypasses;
+        return lookups == 0 ? 0.0 : double(hits) / lookups;
+    }
+};
+
+/**
+ * A regex pattern with a bounded cache of match results in front of it, which
+ * may be used from several threads at once. The cache is split into shards
+ * by the hash of the input, each guarded by its own mutex. A shard is a table
+ * of sets of two entries, the most recently used one first, so that two hot
+ * inputs that map to the same set don't evict each other. Hits are verified
+ * by comparing the input itself, so hash collisions never yield a wrong
+ * result.
+ */
+class cached_pattern
+{
+    static constexpr std::size_t cache_line_size = 64;
+    static constexpr std::size_t num_ways = 2;
+
+    // Whether a result has been computed for the input yet.
+    enum : std::int8_t { unknown = -1 };
+
+    struct entry
+    {
+        std::uint64_t hash = 0;
+        std::string input;
+        std::int8_t match = unknown;
+        std::int8_t contains = unknown;
+        bool is_occupied = false;
+    };
+
+    struct alignas(cache_line_size) shard
+    {
+        std::mutex mutex;
+        std::vector<entry> entries;
+        statistics stats;
+
+        /**
+         * Returns the entry of `input` moved to the front of its set, or
+         * nullptr if it's not cached.
+         */
+        entry* find(const std::uint64_t h, std::string_view input)
+        {
+            auto* set = &entries[std::uint32_t(h) % (entries.size() / num_ways) * num_ways];
+            for(std::size_t way = 0; way < num_ways; ++way) {
+                if(set[way].is_occupied && set[way].hash == h && set[way].input == input) {
+                    std::rotate(set, set + way, set + way + 1);
+                    return set;
+                }
+            }
+            return nullptr;
+        }
+
+        /** Evicts the least recently used entry of the set of `input` for it. */
+        entry& insert(const std::uint64_t h, std::string_view input)
+        {
+            auto* set = &entries[std::uint32_t(h) % (entries.size() / num_ways) * num_ways];
+            std::rotate(set, set + num_ways - 1, set + num_ways);
+            // Reuse the evicted input's storage.
+            set->hash = h;
+            set->input.assign(input);
+            set->match = set->contains = unknown;
+            set->is_occupied = true;
+            return *set;
+        }
+    };
+
+    regex::pattern pattern_;
+    std::unique_ptr<shard[]> shards_;
+    std::size_t num_shards_;
+    std::size_t max_input_size_;
+
+public:
+    explicit cached_pattern(regex::pattern pattern, const options& opts = {})
+        : pattern_(std::move(pattern))
+        , num_shards_(std::min(opts.num_shards, opts.capacity / num_ways))
+        , max_input_size_(opts.max_input_size)
+    {
+        if(opts.capacity < num_ways) {
+            throw std::invalid_argument("capacity must be at least 2");
+        }
+        if(opts.num_shards < 1) {
+            throw std::invalid_argument("number of shards must be larger than zero");
+        }
+        shards_.reset(new shard[num_shards_]);
+        const auto shard_capacity = opts.capacity / (num_shards_ * num_ways) * num_ways;
+        for(std::size_t i = 0; i < num_shards_; ++i) {
+            shards_[i].entries.resize(shard_capacity);
+        }
+    }
+
+    const regex::pattern& pattern() const noexcept { return pattern_; }
+
+    /** The number of inputs that may be cached, see `options::capacity`. */
+    std::size_t capacity() const noexcept
+    {
+        return num_shards_ * shards_[0].entries.size();
+    }
+
+    /** Same as `regex::pattern::match`. */
+    bool match(std::string_view input)
+    {
+        return lookup(input, &entry::match, [this](std::string_view input) {
+            return pattern_.match(input);
+        });
+    }
+
+    /** Same as `regex::pattern::contains`. */
+    bool contains(std::string_view input)
+    {
+        return lookup(input, &entry::contains, [this](std::string_view input) {
+            return pattern_.contains(input);
+        });
+    }
+
+    /** Returns the hit and miss counts over all shards so far. */
+    statistics stats() const
+    {
+        statistics total;
+        for(std::size_t i = 0; i < num_shards_; ++i) {
+            std::lock_guard<std::mutex> lock(shards_[i].mutex);
+            total.hits += shards_[i].stats.hits;
+            total.misses += shards_[i].stats.misses;
+            total.bypasses += shards_[i].stats.bypasses;
+        }
+        return total;
+    }
+
+    /** Empties the cache and resets the statistics. */
+    void clear()
+    {
+        for(std::size_t i = 0; i < num_shards_; ++i) {
+            std::lock_guard<std::mutex> lock(shards_[i].mutex);
+            for(auto& e : shards_[i].entries) {
+                e = entry();
+            }
+            shards_[i].stats = statistics();
+        }
+    }
+
+private:
+    template<typename Match>
+    bool lookup(std::string_view input, std::int8_t entry::* result, Match&& match)
+    {
+        if(input.size() > max_input_size_) {
+            // Bypasses are counted in the first shard so that long inputs
+            // aren't hashed only to pick one.
+            {
+                std::lock_guard<std::mutex> lock(shards_[0].mutex);
+                ++shards_[0].stats.bypasses;
+            }
+            return match(input);
+        }
+
+        const auto h = hash(input);
+        // The shard and the set are picked with different bits of the hash.
+        auto& s = shards_[(h >> 32) % num_shards_];
+
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            const auto* e = s.find(h, input);
+            if(e && e->*result != unknown) {
+                ++s.stats.hits;
+                return e->*result;
+            }
+            ++s.stats.misses;
+        }
+
+        // Match without holding the lock, so that other threads aren't held
+        // up by the DFA run.
+        const bool is_match = match(input);
+        std::lock_guard<std::mutex> lock(s.mutex);
+        auto* e = s.find(h, input);
+        (e ? *e : s.insert(h, input)).*result = is_match;
+        return is_match;
+    }
+};
+
+} // cache
+
+#endif
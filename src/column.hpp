@@ -0,0 +1,153 @@
+#ifndef COLUMN_HEADER
+#define COLUMN_HEADER
+
+#include <string_view>
+#include <vector>
+#include <bitset>
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+
+#if defined(__AVX2__)
+# include <immintrin.h>
+#endif
+
+#include "fsm.hpp"
+
+/**
+ * Filtering of dictionary-encoded string columns, in which each row holds
+ * a code that indexes into a dictionary of the column's distinct values.
+ * A DFA is then only run once per dictionary entry rather than once per row,
+ * and the rows are selected by looking up their codes in the result.
+ */
+namespace column {
+
+using code_t = std::uint32_t;
+
+/** A fixed-size set of bits, stored in 64-bit words, least significant bit first. */
+class bitmap
+{
+    std::vector<std::uint64_t> words_;
+    std::size_t size_;
+
+public:
+    explicit bitmap(const std::size_t size = 0)
+        : words_((size + 63) / 64, 0)
+        , size_(size)
+    {}
+
+    std::size_t size() const noexcept { return size_; }
+
+    bool test(const std::size_t i) const noexcept
+    {
+        assert(i < size_);
+        return (words_[i / 64] >> (i % 64)) & 1;
+    }
+
+    void set(const std::size_t i) noexcept
+    {
+        assert(i < size_);
+        words_[i / 64] |= std::uint64_t(1) << (i % 64);
+    }
+
+    /** The number of set bits. */
+    std::size_t count() const noexcept
+    {
+        std::size_t n = 0;
+        for(const auto word : words_) {
+            n += std::bitset<64>(word).count();
+        }
+        return n;
+    }
+
+    const std::uint64_t* data() const noexcept { return words_.data(); }
+    std::uint64_t* data() noexcept { return words_.data(); }
+
+    std::size_t num_words() const noexcept { return words_.size(); }
+};
+
+/**
+ * Returns the bitmap of the entries of `dictionary`, a range of types
+ * convertible to `std::string_view`, that `dfa` matches (in its match mode).
+ */
+template<typename Dictionary>
+bitmap match_dictionary(const fsm::frozen_dfa& dfa, const Dictionary& dictionary)
+{
+    std::vector<std::string_view> entries;
+    for(const auto& entry : dictionary) {
+        entries.emplace_back(entry);
+    }
+    bitmap selection(entries.size());
+    for(std::size_t i = 0; i < entries.size(); ++i) {
+        if(dfa.simulate(entries[i]) == fsm::result::accept) {
+            selection.set(i);
+        }
+    }
+    return selection;
+}
+
+/**
+ * Returns the bitmap of the rows whose code is selected in `selection`, the
+ * bitmap over the dictionary. All codes must be less than the dictionary's
+ * size.
+ *
+ * With AVX2, the bits of eight codes are looked up at a time by gathering
+ * the 32-bit words of `selection` they're in, and each such word is shifted
+ * such that the bit ends up as the sign bit, so that a sign mask yields the
+ * bits of the eight rows at once.
+ */
+inline bitmap select(const bitmap& selection, const code_t* codes, const std::size_t num_rows)
+{
+    bitmap rows(num_rows);
+    auto* out = rows.data();
+    std::size_t i = 0;
+#if defined(__AVX2__)
+    const auto* selection_words = reinterpret_cast<const int*>(selection.data());
+    const auto bit_mask = _mm256_set1_epi32(31);
+    for(; num_rows - i >= 64; i += 64) {
+        assert(std::all_of(codes + i, codes + i + 64,
+            [&selection](const code_t c) { return c < selection.size(); }));
+        std::uint64_t word = 0;
+        for(auto j = 0; j < 64; j += 8) {
+            const auto c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(codes + i + j));
+            const auto selected = _mm256_i32gather_epi32(selection_words, _mm256_srli_epi32(c, 5), 4);
+            const auto shifted = _mm256_sllv_epi32(selected,
+                _mm256_sub_epi32(bit_mask, _mm256_and_si256(c, bit_mask)));
+            word |= std::uint64_t(_mm256_movemask_ps(_mm256_castsi256_ps(shifted))) << j;
+        }
+        out[i / 64] = word;
+    }
+#endif
+    const auto* words = selection.data();
+    for(; i < num_rows; ++i) {
+        assert(codes[i] < selection.size());
+        out[i / 64] |= ((words[codes[i] / 64] >> (codes[i] % 64)) & 1) << (i % 64);
+    }
+    return rows;
+}
+
+inline bitmap select(const bitmap& selection, const std::vector<code_t>& codes)
+{
+    return select(selection, codes.data(), codes.size());
+}
+
+/**
+ * Returns the bitmap of the rows of a dictionary-encoded column whose value
+ * `dfa` matches, see `match_dictionary` and `select`.
+ */
+template<typename Dictionary>
+bitmap filter(const fsm::frozen_dfa& dfa, const Dictionary& dictionary, const code_t* codes,
+    const std::size_t num_rows)
+{
+    return select(match_dictionary(dfa, dictionary), codes, num_rows);
+}
+
+template<typename Dictionary>
+bitmap filter(const fsm::frozen_dfa& dfa, const Dictionary& dictionary, const std::vector<code_t>& codes)
+{
+    return filter(dfa, dictionary, codes.data(), codes.size());
+}
+
+} // column
+
+#endif
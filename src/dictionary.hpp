@@ -0,0 +1,167 @@
+#ifndef DICTIONARY_HEADER
+#define DICTIONARY_HEADER
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+#include <cstdint>
+
+#include "fsm.hpp"
+
+namespace dictionary {
+
+using term_id = std::uint32_t;
+
+/**
+ * A static dictionary of terms stored as a trie, which is queried with
+ * a DFA by walking the trie and the DFA in lockstep, so that a subtree is
+ * skipped as soon as the DFA can't accept any of its terms anymore. A query
+ * thus only visits the prefixes of the terms that the DFA may still accept,
+ * rather than every term.
+ *
+ * Terms are identified by their rank in lexicographic (byte) order, and the
+ * terms below a node are the contiguous range of ids from the first term
+ * with the node's prefix.
+ */
+class trie
+{
+    struct node
+    {
+        std::uint32_t first_edge;
+        std::uint32_t num_edges;
+        // The range of the ids of the terms in the subtree.
+        term_id first_term;
+        term_id last_term;
+        // Whether the prefix of the node is itself a term (`first_term`).
+        bool is_term;
+    };
+
+    struct edge
+    {
+        unsigned char label;
+        std::uint32_t child;
+    };
+
+    std::vector<node> nodes_;
+    std::vector<edge> edges_;
+    std::string terms_;
+    std::vector<std::size_t> term_offsets_;
+
+public:
+    /** Builds the trie of `terms`, which need not be sorted nor unique. */
+    explicit trie(std::vector<std::string> terms)
+    {
+        std::sort(terms.begin(), terms.end());
+        terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+        for(const auto& t : terms) {
+            term_offsets_.push_back(terms_.size());
+            terms_ += t;
+        }
+        term_offsets_.push_back(terms_.size());
+
+        // Each node covers a range of the sorted terms that share the prefix
+        // of its depth, and its children split this range by the next byte.
+        struct range { std::uint32_t node; term_id first; term_id last; std::size_t depth; };
+        std::vector<range> to_process;
+        nodes_.push_back({0, 0, 0, term_id(terms.size()), false});
+        to_process.push_back({0, 0, term_id(terms.size()), 0});
+        while(!to_process.empty()) {
+            const auto r = to_process.back();
+            to_process.pop_back();
+            auto first = r.first;
+            if(first < r.last && terms[first].size() == r.depth) {
+                nodes_[r.node].is_term = true;
+                ++first;
+            }
+            nodes_[r.node].first_edge = edges_.size();
+            while(first < r.last) {
+                const auto label = static_cast<unsigned char>(terms[first][r.depth]);
+                auto last = first + 1;
+                while(last < r.last && static_cast<unsigned char>(terms[last][r.depth]) == label) {
+                    ++last;
+                }
+                const std::uint32_t child = nodes_.size();
+                nodes_.push_back({0, 0, first, last, false});
+                edges_.push_back({label, child});
+                to_process.push_back({child, first, last, r.depth + 1});
+                first = last;
+            }
+            nodes_[r.node].num_edges = edges_.size() - nodes_[r.node].first_edge;
+        }
+    }
+
+    std::size_t size() const noexcept { return term_offsets_.size() - 1; }
+
+    /** The number of nodes, i.e. of distinct prefixes of the terms. */
+    std::size_t num_nodes() const noexcept { return nodes_.size(); }
+
+    std::string_view term(const term_id id) const noexcept
+    {
+        return std::string_view(terms_).substr(term_offsets_[id],
+            term_offsets_[id + 1] - term_offsets_[id]);
+    }
+
+    /**
+     * Invokes `on_term(term_id, std::string_view term)` for each term that
+     * `dfa` accepts (in the DFA's match mode), in lexicographic order. If
+     * `on_term` returns a value, the query stops as soon as it returns
+     * false. Returns the number of nodes visited.
+     *
+     * Once the DFA reaches a terminal accepting state, e.g. when matching
+     * a prefix, all the terms below are reported without walking them.
+     */
+    template<typename OnTerm>
+    std::size_t query(const fsm::frozen_dfa& dfa, OnTerm&& on_term) const
+    {
+        const auto report = [&](const term_id id) {
+            if constexpr(std::is_void_v<std::invoke_result_t<OnTerm&, term_id, std::string_view>>) {
+                on_term(id, term(id));
+                return true;
+            } else {
+                return bool(on_term(id, term(id)));
+            }
+        };
+
+        std::size_t num_visited = 0;
+        std::vector<std::pair<std::uint32_t, fsm::state_t>> to_visit{{0, dfa.start_state()}};
+        while(!to_visit.empty()) {
+            const auto [n, s] = to_visit.back();
+            to_visit.pop_back();
+            ++num_visited;
+            const auto& node = nodes_[n];
+            if(dfa.is_terminal(s)) {
+                if(dfa.is_accepting(s)) {
+                    for(auto id = node.first_term; id < node.last_term; ++id) {
+                        if(!report(id)) { return num_visited; }
+                    }
+                }
+                continue;
+            }
+            if(node.is_term && dfa.is_accepting(s) && !report(node.first_term)) {
+                return num_visited;
+            }
+            // Visit children in order by pushing them in reverse.
+            for(auto e = node.first_edge + node.num_edges; e-- > node.first_edge;) {
+                const auto t = dfa.next(s, edges_[e].label);
+                if(dfa.is_live(t)) {
+                    to_visit.emplace_back(edges_[e].child, t);
+                }
+            }
+        }
+        return num_visited;
+    }
+
+    /** Returns the terms that `dfa` accepts, in lexicographic order. */
+    std::vector<std::string_view> matches(const fsm::frozen_dfa& dfa) const
+    {
+        std::vector<std::string_view> result;
+        query(dfa, [&result](term_id, std::string_view term) { result.push_back(term); });
+        return result;
+    }
+};
+
+} // dictionary
+
+#endif
@@ -0,0 +1,225 @@
+#ifndef DNA_HEADER
+#define DNA_HEADER
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <stack>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdint>
+
+#include "fsm.hpp"
+#include "scanner.hpp"
+
+/**
+ * Matching of nucleotide sequences that are packed into two bits per base,
+ * four bases per byte, the first base in the most significant bits. The
+ * bases are encoded as A = 0, C = 1, G = 2 and T = 3.
+ */
+namespace dna {
+
+constexpr char bases[] = {'A', 'C', 'G', 'T'};
+constexpr int bases_per_byte = 4;
+
+/** Returns the code of `base`, which must be one of A, C, G or T. */
+inline unsigned char encode(const char base)
+{
+    switch(base) {
+    case 'A': return 0;
+    case 'C': return 1;
+    case 'G': return 2;
+    case 'T': return 3;
+    }
+    throw std::invalid_argument("invalid nucleotide");
+}
+
+/** Packs a sequence of bases, padding the last byte with A's. */
+inline std::vector<unsigned char> pack(std::string_view sequence)
+{
+    std::vector<unsigned char> packed((sequence.size() + bases_per_byte - 1) / bases_per_byte);
+    for(std::size_t i = 0; i < sequence.size(); ++i) {
+        packed[i / bases_per_byte] |= encode(sequence[i]) << (6 - 2 * (i % bases_per_byte));
+    }
+    return packed;
+}
+
+inline std::string unpack(const unsigned char* packed, const std::size_t num_bases)
+{
+    std::string sequence(num_bases, '\0');
+    for(std::size_t i = 0; i < num_bases; ++i) {
+        sequence[i] = bases[(packed[i / bases_per_byte] >> (6 - 2 * (i % bases_per_byte))) & 3];
+    }
+    return sequence;
+}
+
+/**
+ * A DFA specialized to the four bases, which consumes a whole packed byte,
+ * i.e. four bases, per transition through a table of 256 entries per state,
+ * so that packed input is matched without being unpacked and at a quarter of
+ * the transitions per base.
+ *
+ * It is derived from a frozen DFA over the characters A, C, G and T, from
+ * which only the states reachable on those characters are kept. Since in
+ * prefix and search match modes accepting states are absorbing, only the
+ * state after each four bases has to be checked in any mode.
+ */
+class dfa
+{
+    // The transitions on a single base, and on four bases at a time.
+    std::vector<fsm::state_t> transitions_;
+    std::vector<fsm::state_t> stride_transitions_;
+    std::vector<char> accepting_;
+    std::vector<char> live_;
+    std::vector<char> terminal_;
+    fsm::state_t start_;
+
+public:
+    explicit dfa(const fsm::frozen_dfa& dfa)
+    {
+        // Renumber the states that are reachable on bases alone.
+        std::map<fsm::state_t, fsm::state_t> ids;
+        std::vector<fsm::state_t> originals;
+        std::stack<fsm::state_t> to_process;
+        const auto get_state = [&](const fsm::state_t s) {
+            const auto [it, inserted] = ids.try_emplace(s, ids.size());
+            if(inserted) {
+                originals.push_back(s);
+                to_process.push(s);
+            }
+            return it->second;
+        };
+        start_ = get_state(dfa.start_state());
+        while(!to_process.empty()) {
+            const auto s = to_process.top();
+            to_process.pop();
+            const auto from = ids[s];
+            transitions_.resize(ids.size() * bases_per_byte);
+            for(auto b = 0; b < bases_per_byte; ++b) {
+                transitions_[from * bases_per_byte + b] = get_state(dfa.next(s, bases[b]));
+            }
+        }
+
+        for(const auto s : originals) {
+            accepting_.push_back(dfa.is_accepting(s));
+        }
+        compute_terminal_states();
+
+        stride_transitions_.resize(size() * fsm::frozen_dfa::alphabet_size);
+        for(fsm::state_t s = 0; s < size(); ++s) {
+            for(auto byte = 0; byte < fsm::frozen_dfa::alphabet_size; ++byte) {
+                auto t = s;
+                for(auto i = 0; i < bases_per_byte; ++i) {
+                    t = next(t, (byte >> (6 - 2 * i)) & 3);
+                }
+                stride_transitions_[s * fsm::frozen_dfa::alphabet_size + byte] = t;
+            }
+        }
+    }
+
+    int size() const noexcept { return accepting_.size(); }
+
+    fsm::state_t start_state() const noexcept { return start_; }
+
+    bool is_accepting(const fsm::state_t s) const noexcept { return accepting_[s]; }
+
+    /** See `fsm::frozen_dfa::is_terminal`. */
+    bool is_terminal(const fsm::state_t s) const noexcept { return terminal_[s]; }
+
+    fsm::result classify(const fsm::state_t s) const noexcept
+    {
+        if(is_accepting(s)) { return fsm::result::accept; }
+        return live_[s] ? fsm::result::partial : fsm::result::reject;
+    }
+
+    /** Returns the state reached from `s` on the base with code `base`. */
+    fsm::state_t next(const fsm::state_t s, const unsigned char base) const noexcept
+    {
+        return transitions_[s * bases_per_byte + base];
+    }
+
+    /**
+     * Returns the state reached from `s` after consuming the first
+     * `num_bases` bases packed in `packed`. Consumption stops early at
+     * a terminal state.
+     */
+    fsm::state_t step(fsm::state_t s, const unsigned char* packed, const std::size_t num_bases) const noexcept
+    {
+        const auto num_bytes = num_bases / bases_per_byte;
+        for(std::size_t i = 0; i < num_bytes; ++i) {
+            if(terminal_[s]) { return s; }
+            s = stride_transitions_[s * fsm::frozen_dfa::alphabet_size + packed[i]];
+        }
+        const auto last = num_bytes < (num_bases + bases_per_byte - 1) / bases_per_byte
+            ? packed[num_bytes] : 0;
+        for(std::size_t i = 0; i < num_bases % bases_per_byte; ++i) {
+            s = next(s, (last >> (6 - 2 * i)) & 3);
+        }
+        return s;
+    }
+
+    /** Returns whether the DFA matches the packed sequence, see `frozen_dfa::simulate`. */
+    fsm::result simulate(const unsigned char* packed, const std::size_t num_bases) const noexcept
+    {
+        return is_accepting(step(start_, packed, num_bases)) ? fsm::result::accept : fsm::result::reject;
+    }
+
+    fsm::result simulate(const std::vector<unsigned char>& packed, const std::size_t num_bases) const noexcept
+    {
+        return simulate(packed.data(), std::min(num_bases, packed.size() * bases_per_byte));
+    }
+
+private:
+    /**
+     * Determines which states can still reach an accepting state, and which
+     * states are terminal (see `frozen_dfa::is_terminal`), on bases alone.
+     */
+    void compute_terminal_states()
+    {
+        live_ = accepting_;
+        std::vector<char> accepts_always = accepting_;
+        for(bool has_changed = true; has_changed;) {
+            has_changed = false;
+            for(fsm::state_t s = 0; s < size(); ++s) {
+                for(auto b = 0; b < bases_per_byte; ++b) {
+                    const auto t = next(s, b);
+                    if(!live_[s] && live_[t]) {
+                        live_[s] = true;
+                        has_changed = true;
+                    }
+                    if(accepts_always[s] && !accepts_always[t]) {
+                        accepts_always[s] = false;
+                        has_changed = true;
+                    }
+                }
+            }
+        }
+        terminal_.resize(size());
+        for(fsm::state_t s = 0; s < size(); ++s) {
+            terminal_[s] = !live_[s] || accepts_always[s];
+        }
+    }
+};
+
+/**
+ * Simulates `dfa` over the first `num_bases` bases packed in the file at
+ * `path`, reading it with the chosen I/O backend. Reading stops after those
+ * bases or as soon as the DFA reaches a terminal state.
+ */
+inline fsm::result scan_file(const dfa& dfa, const char* path, std::uint64_t num_bases,
+    const scanner::options& opts = {})
+{
+    auto s = dfa.start_state();
+    scanner::read_file(path, opts, [&](std::string_view chunk) {
+        const auto n = std::min<std::uint64_t>(num_bases, chunk.size() * bases_per_byte);
+        s = dfa.step(s, reinterpret_cast<const unsigned char*>(chunk.data()), n);
+        num_bases -= n;
+        return num_bases > 0 && !dfa.is_terminal(s);
+    });
+    return dfa.is_accepting(s) ? fsm::result::accept : fsm::result::reject;
+}
+
+} // dna
+
+#endif
@@ -6,9 +6,12 @@
 #include <stdexcept>
 #include <cassert>
 #include <stack>
+#include <string>
 #include <string_view>
 #include <set>
 #include <map>
+#include <optional>
+#include <cstdint>
 
 namespace fsm {
 
@@ -19,12 +22,21 @@ enum {
 };
 
 enum class result {
-    accept, reject
+    accept, reject,
+    /**
+     * Only returned when simulating a possibly incomplete input: the input is
+     * not matched, but some continuation of it would be.
+     */
+    partial,
 };
 
 inline std::set<input_t> derive_input_language(std::string_view s)
 {
-    return {s.begin(), s.end()};
+    std::set<input_t> lang;
+    for(const auto c : s) {
+        lang.insert(static_cast<unsigned char>(c));
+    }
+    return lang;
 }
 
 struct nfa
@@ -236,6 +248,20 @@ private:
     }
 };
 
+/** Returns all inputs on which `nfa` has a transition. */
+inline std::set<input_t> derive_input_language(const nfa& nfa)
+{
+    std::set<input_t> lang;
+    for(const auto& row : nfa.transition_table()) {
+        for(const auto input : row) {
+            if(input != 0 && input != epsilon) {
+                lang.insert(input);
+            }
+        }
+    }
+    return lang;
+}
+
 struct dfa
 {
     using transition_table_type =
@@ -249,42 +275,95 @@ private:
 public:
     /** Constructs a DFA from an NFA and an input language via subset construction. */
     dfa(const nfa& nfa, const std::set<input_t>& input_lang)
-        : start_(transition_table_.end())
-        , final_state_(nfa.final_state())
+        : final_state_(nfa.final_state())
     {
+        // The NFA's transitions as adjacency lists, so that the transitions
+        // of a set of NFA states are found in time proportional to their
+        // number rather than to the size of the NFA. Like in the NFA, a state
+        // is in its own epsilon closure and other transitions to itself are
+        // ignored.
+        std::vector<std::vector<std::pair<input_t, state_t>>> transitions(nfa.size());
+        std::vector<std::vector<state_t>> epsilon_transitions(nfa.size());
+        for(state_t from = 0; from < nfa.size(); ++from) {
+            const auto& row = nfa.transition_table()[from];
+            for(state_t to = 0; to < nfa.size(); ++to) {
+                if(to == from) { continue; }
+                if(row[to] == epsilon) {
+                    epsilon_transitions[from].push_back(to);
+                } else if(input_lang.find(row[to]) != input_lang.end()) {
+                    transitions[from].emplace_back(row[to], to);
+                }
+            }
+        }
+        // States that only have epsilon transitions and aren't final don't
+        // affect what a set of states matches once its epsilon closure is
+        // taken, so they are left out of the DFA's states, which would
+        // otherwise tell apart sets that only differ in them.
+        const auto epsilon_closure = [&](std::set<state_t> states) {
+            std::stack<state_t, std::vector<state_t>> stack(
+                std::vector<state_t>(states.begin(), states.end()));
+            while(!stack.empty()) {
+                const auto t = stack.top();
+                stack.pop();
+                for(const auto u : epsilon_transitions[t]) {
+                    if(states.insert(u).second) {
+                        stack.push(u);
+                    }
+                }
+            }
+            for(auto it = states.begin(); it != states.end();) {
+                if(transitions[*it].empty() && *it != nfa.final_state()) {
+                    it = states.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            return states;
+        };
+
+        const auto start_closure = epsilon_closure({nfa.start_state()});
+        transition_table_[start_closure];
+
         std::stack<std::set<state_t>> to_process;
-        to_process.push(nfa.epsilon_closure({nfa.start_state()}));
+        to_process.push(start_closure);
 
         while(!to_process.empty()) {
             auto start_states = std::move(to_process.top());
             to_process.pop();
-            for(const auto input : input_lang) {
-                // Compute all reachable states given `input`.
-                auto reachable = nfa.reachable_states(start_states, input);
-                if(!reachable.empty()) {
-                    // Compute the epsilon closure of `reachable` so that
-                    // epsilon transitions are considered as well (the result
-                    // includes the original `reachable` set).
-                    reachable = nfa.epsilon_closure(reachable);
-
-                    // Connect the two states in the transition table.
-                    auto& transitions = transition_table_[start_states];
-                    transitions[input] = reachable;
-
+            // Compute all reachable states given each input.
+            std::map<input_t, std::set<state_t>> reachable_by_input;
+            for(const auto from : start_states) {
+                for(const auto& [input, to] : transitions[from]) {
+                    reachable_by_input[input].insert(to);
+                }
+            }
+            for(auto& [input, reachable] : reachable_by_input) {
+                // Compute the epsilon closure of `reachable` so that epsilon
+                // transitions are considered as well (the result includes the
+                // original `reachable` set).
+                reachable = epsilon_closure(std::move(reachable));
+
+                // Connect the two states in the transition table.
+                transition_table_[start_states][input] = reachable;
+
+                // Every DFA state must only be processed once, otherwise
+                // a cycle in the NFA (e.g. a Kleene star) would never let the
+                // loop terminate.
+                const auto [_, inserted] = transition_table_.try_emplace(reachable);
+                if(inserted) {
                     to_process.push(std::move(reachable));
-                    if(start_ == transition_table_.end()) {
-                        start_ = transition_table_.begin();
-                    }
                 }
             }
         }
 
-        assert(transition_table_.find({final_state_}) == transition_table_.end());
-        transition_table_[{final_state_}] = {};
+        start_ = transition_table_.find(start_closure);
     }
 
     const transition_table_type& transition_table() const { return transition_table_; }
 
+    const std::set<state_t>& start_state() const { return start_->first; }
+    state_t final_state() const noexcept { return final_state_; }
+
     /**
      * Simulates the DFA given an input string. If simulation ends in
      * a matched/final state, the return value is result::accept, but if the
@@ -297,7 +376,7 @@ public:
         for(auto c : input) {
             if(state == transition_table_.end()) { return result::reject; }
             const auto& [_, transitions] = *state;
-            const auto& transition = transitions.find(c);
+            const auto& transition = transitions.find(static_cast<unsigned char>(c));
             if(transition == transitions.end()) { return result::reject; }
             state = transition_table_.find(transition->second);
         }
@@ -312,6 +391,608 @@ public:
     }
 };
 
+enum class match_mode
+{
+    /** The whole input must be matched. */
+    full,
+    /** Some prefix of the input must be matched. */
+    prefix,
+    /** Some substring of the input must be matched. */
+    search,
+};
+
+/**
+ * A DFA whose states are numbered consecutively and whose transitions are
+ * stored in a dense table indexed by state and input byte, so that a single
+ * transition is a single array lookup. State 0 is the dead state: all inputs
+ * not accepted by the original DFA lead to it and it can never be left.
+ */
+struct frozen_dfa
+{
+    static constexpr state_t dead_state = 0;
+    static constexpr int alphabet_size = 256;
+    /** Denotes that a state is not accepting. */
+    static constexpr int no_pattern = -1;
+
+private:
+    std::vector<state_t> transitions_;
+    // The id of the pattern a state accepts, or `no_pattern`.
+    std::vector<int> accepted_;
+    // Whether an accepting state is reachable from a state (i.e. whether the
+    // state is co-reachable).
+    std::vector<char> live_;
+    // Whether a state is dead or accepts regardless of the rest of the input,
+    // so that simulation may stop once it's reached.
+    std::vector<char> terminal_;
+    state_t start_;
+    match_mode mode_;
+
+public:
+    /**
+     * In prefix and search modes, accepting states are made absorbing, and in
+     * search mode the DFA is additionally made unanchored, i.e. it restarts
+     * the original DFA at every input position. Accepting states accept
+     * pattern 0.
+     */
+    explicit frozen_dfa(const dfa& dfa, const match_mode mode = match_mode::full)
+        : mode_(mode)
+    {
+        const auto& table = dfa.transition_table();
+        std::map<std::set<state_t>, state_t> ids;
+        state_t id = dead_state;
+        for(const auto& [states, _] : table) {
+            ids.emplace(states, ++id);
+        }
+
+        transitions_.resize((ids.size() + 1) * alphabet_size, dead_state);
+        accepted_.resize(ids.size() + 1, no_pattern);
+        for(const auto& [states, transitions] : table) {
+            const auto from = ids[states];
+            if(states.find(dfa.final_state()) != states.end()) {
+                accepted_[from] = 0;
+            }
+            for(const auto& [input, to] : transitions) {
+                // Inputs originate from `char`s, which may be signed.
+                if(input < -128 || input >= alphabet_size) { continue; }
+                const auto byte = static_cast<unsigned char>(input);
+                transitions_[from * alphabet_size + byte] = ids[to];
+            }
+        }
+        start_ = ids[dfa.start_state()];
+        apply_mode();
+    }
+
+    /**
+     * Constructs a frozen DFA from a dense transition table indexed by state
+     * and input byte, and the id of the pattern each state accepts (or
+     * `no_pattern`), e.g. for automata that are built directly rather than
+     * from regexes. State 0 must be the dead state.
+     */
+    static frozen_dfa from_table(std::vector<state_t> transitions, std::vector<int> accepted,
+        const state_t start, const match_mode mode = match_mode::full)
+    {
+        const state_t size = accepted.size();
+        if(size < 1 || transitions.size() != accepted.size() * alphabet_size) {
+            throw std::invalid_argument("transition table doesn't match the number of states");
+        }
+        if(start < 0 || start >= size
+           || std::any_of(transitions.begin(), transitions.end(),
+               [size](const state_t t) { return t < 0 || t >= size; })) {
+            throw std::invalid_argument("invalid state");
+        }
+        if(accepted[dead_state] != no_pattern
+           || std::any_of(transitions.begin(), transitions.begin() + alphabet_size,
+               [](const state_t t) { return t != dead_state; })) {
+            throw std::invalid_argument("state 0 must be the dead state");
+        }
+
+        frozen_dfa result;
+        result.transitions_ = std::move(transitions);
+        result.accepted_ = std::move(accepted);
+        result.start_ = start;
+        result.mode_ = mode;
+        result.apply_mode();
+        return result;
+    }
+
+    /**
+     * Combines several full match mode DFAs into a single DFA that simulates
+     * all of them at once (via product construction). A state accepts the
+     * index of the first of `dfas` that accepts in it.
+     */
+    static frozen_dfa combine(const std::vector<frozen_dfa>& dfas,
+        const match_mode mode = match_mode::full)
+    {
+        if(dfas.empty()) {
+            throw std::invalid_argument("at least one DFA must be combined");
+        }
+        for(const auto& dfa : dfas) {
+            if(dfa.mode() != match_mode::full) {
+                throw std::invalid_argument("only full match mode DFAs may be combined");
+            }
+        }
+
+        frozen_dfa result;
+        result.mode_ = mode;
+        std::map<std::vector<state_t>, state_t> ids;
+        std::stack<std::vector<state_t>> to_process;
+
+        const auto add_state = [&](std::vector<state_t> states) {
+            const auto [it, inserted] = ids.try_emplace(states, ids.size());
+            if(inserted) {
+                result.transitions_.resize(ids.size() * alphabet_size, dead_state);
+                int accepted = no_pattern;
+                for(std::size_t i = 0; i < dfas.size(); ++i) {
+                    if(dfas[i].is_accepting(states[i])) {
+                        accepted = i;
+                        break;
+                    }
+                }
+                result.accepted_.push_back(accepted);
+                to_process.push(std::move(states));
+            }
+            return it->second;
+        };
+
+        add_state(std::vector<state_t>(dfas.size(), dead_state));
+        std::vector<state_t> start;
+        for(const auto& dfa : dfas) {
+            start.push_back(dfa.start_state());
+        }
+        result.start_ = add_state(std::move(start));
+
+        while(!to_process.empty()) {
+            const auto states = std::move(to_process.top());
+            to_process.pop();
+            const auto from = ids[states];
+            for(auto c = 0; c < alphabet_size; ++c) {
+                std::vector<state_t> reachable(dfas.size());
+                for(std::size_t i = 0; i < dfas.size(); ++i) {
+                    reachable[i] = dfas[i].next(states[i], c);
+                }
+                result.transitions_[from * alphabet_size + c] = add_state(std::move(reachable));
+            }
+        }
+
+        result.apply_mode();
+        return result;
+    }
+
+    /**
+     * Returns a full match mode DFA that accepts the reversed inputs that
+     * lead from the start of `dfa` to a live state, i.e. the reversed
+     * prefixes of the inputs `dfa` accepts. Run backwards from where a match
+     * ends, it finds the positions at which it may have started.
+     *
+     * Subset construction may yield exponentially more states than `dfa`
+     * has, so nothing is returned once more than `max_states` are needed.
+     */
+    static std::optional<frozen_dfa> reverse_prefixes(const frozen_dfa& dfa, const int max_states)
+    {
+        // The live states, and the transitions between them reversed.
+        std::vector<state_t> live;
+        std::vector<std::vector<std::pair<unsigned char, state_t>>> predecessors(dfa.size());
+        for(state_t s = 0; s < dfa.size(); ++s) {
+            if(!dfa.is_live(s)) { continue; }
+            live.push_back(s);
+            for(auto c = 0; c < alphabet_size; ++c) {
+                const auto t = dfa.next(s, c);
+                if(dfa.is_live(t)) {
+                    predecessors[t].emplace_back(c, s);
+                }
+            }
+        }
+
+        std::vector<state_t> transitions;
+        std::vector<int> accepted;
+        std::map<std::vector<state_t>, state_t> ids;
+        std::stack<std::vector<state_t>> to_process;
+        const auto add_state = [&](std::vector<state_t> states) {
+            const auto [it, inserted] = ids.try_emplace(states, ids.size());
+            if(inserted) {
+                transitions.resize(ids.size() * alphabet_size, dead_state);
+                const auto is_start = std::binary_search(states.begin(), states.end(), dfa.start_state());
+                accepted.push_back(is_start ? 0 : no_pattern);
+                to_process.push(std::move(states));
+            }
+            return it->second;
+        };
+
+        add_state({});
+        // Any live state may be where a prefix ends.
+        const auto start = add_state(std::move(live));
+        while(!to_process.empty()) {
+            if(int(ids.size()) > max_states) { return std::nullopt; }
+            const auto states = std::move(to_process.top());
+            to_process.pop();
+            const auto from = ids[states];
+            std::vector<std::vector<state_t>> reachable(alphabet_size);
+            for(const auto t : states) {
+                for(const auto& [c, s] : predecessors[t]) {
+                    reachable[c].push_back(s);
+                }
+            }
+            for(auto c = 0; c < alphabet_size; ++c) {
+                auto& r = reachable[c];
+                std::sort(r.begin(), r.end());
+                r.erase(std::unique(r.begin(), r.end()), r.end());
+                transitions[from * alphabet_size + c] = add_state(std::move(r));
+            }
+        }
+        return from_table(std::move(transitions), std::move(accepted), start);
+    }
+
+    match_mode mode() const noexcept { return mode_; }
+
+    int size() const noexcept { return accepted_.size(); }
+
+    state_t start_state() const noexcept { return start_; }
+
+    bool is_accepting(const state_t s) const noexcept { return accepted_[s] != no_pattern; }
+
+    /** Returns the id of the pattern `s` accepts, or `no_pattern`. */
+    int accepted_pattern(const state_t s) const noexcept { return accepted_[s]; }
+
+    /** Returns whether some input leads from `s` to an accepting state. */
+    bool is_live(const state_t s) const noexcept { return live_[s]; }
+
+    /**
+     * Returns whether no further input can change whether `s` accepts, i.e.
+     * whether `s` is dead or all inputs only lead to accepting states.
+     */
+    bool is_terminal(const state_t s) const noexcept { return terminal_[s]; }
+
+    bool is_legal_state(const state_t s) const noexcept
+    {
+        return s >= 0 && s < size();
+    }
+
+    /**
+     * Returns result::accept if `s` is accepting, result::reject if no input
+     * can lead from `s` to an accepting state, and result::partial otherwise.
+     */
+    result classify(const state_t s) const noexcept
+    {
+        if(is_accepting(s)) { return result::accept; }
+        return is_live(s) ? result::partial : result::reject;
+    }
+
+    state_t next(const state_t s, const unsigned char c) const noexcept
+    {
+        return transitions_[s * alphabet_size + c];
+    }
+
+    /**
+     * Returns the state reached from `s` after consuming `input`. Consumption
+     * stops early at a terminal state, as the rest of the input can't change
+     * the outcome anymore.
+     */
+    state_t step(state_t s, std::string_view input) const noexcept
+    {
+        for(const unsigned char c : input) {
+            if(is_terminal(s)) { break; }
+            s = next(s, c);
+        }
+        return s;
+    }
+
+    /**
+     * Same as `dfa::simulate` in full match mode, otherwise accepts if
+     * a prefix or substring of `input`, respectively, is matched.
+     */
+    result simulate(std::string_view input) const noexcept
+    {
+        return is_accepting(step(start_, input)) ? result::accept : result::reject;
+    }
+
+    /**
+     * Simulates the DFA on an input that may only be a prefix of the complete
+     * input. Returns result::reject as soon as no continuation of the input
+     * can be matched anymore, without consuming the rest of the input.
+     */
+    result simulate_prefix(std::string_view input) const noexcept
+    {
+        return classify(step(start_, input));
+    }
+
+private:
+    frozen_dfa() = default;
+
+    void apply_mode()
+    {
+        if(mode_ == match_mode::search) {
+            unanchor();
+        }
+        if(mode_ != match_mode::full) {
+            for(state_t s = 0; s < size(); ++s) {
+                if(is_accepting(s)) {
+                    std::fill_n(&transitions_[s * alphabet_size], alphabet_size, s);
+                }
+            }
+        }
+        compute_liveness();
+        compute_terminal_states();
+    }
+
+    /**
+     * Replaces the DFA with one that simulates the original DFA from every
+     * input position at once, via subset construction over the original
+     * DFA's states.
+     */
+    void unanchor()
+    {
+        std::vector<state_t> transitions;
+        std::vector<int> accepted;
+        std::map<std::vector<state_t>, state_t> ids;
+        std::stack<std::vector<state_t>> to_process;
+
+        const auto add_state = [&](std::vector<state_t> states) {
+            const auto [it, inserted] = ids.try_emplace(states, ids.size());
+            if(inserted) {
+                transitions.resize(ids.size() * alphabet_size, dead_state);
+                // The lowest pattern id takes precedence.
+                int pattern = no_pattern;
+                for(const auto s : states) {
+                    const auto p = accepted_pattern(s);
+                    if(p != no_pattern && (pattern == no_pattern || p < pattern)) {
+                        pattern = p;
+                    }
+                }
+                accepted.push_back(pattern);
+                to_process.push(std::move(states));
+            }
+            return it->second;
+        };
+
+        add_state({});
+        const auto start = add_state({start_});
+        while(!to_process.empty()) {
+            const auto states = std::move(to_process.top());
+            to_process.pop();
+            const auto from = ids[states];
+            // There is no point in tracking more states once one of them has
+            // accepted since the accepting state is going to be absorbing.
+            if(accepted[from] != no_pattern) { continue; }
+            for(auto c = 0; c < alphabet_size; ++c) {
+                std::vector<state_t> reachable{start_};
+                for(const auto s : states) {
+                    const auto t = next(s, c);
+                    if(t != dead_state) {
+                        reachable.push_back(t);
+                    }
+                }
+                std::sort(reachable.begin(), reachable.end());
+                reachable.erase(std::unique(reachable.begin(), reachable.end()), reachable.end());
+                transitions[from * alphabet_size + c] = add_state(std::move(reachable));
+            }
+        }
+
+        transitions_ = std::move(transitions);
+        accepted_ = std::move(accepted);
+        start_ = start;
+    }
+
+    void compute_liveness()
+    {
+        std::vector<std::vector<state_t>> predecessors(size());
+        for(state_t s = 0; s < size(); ++s) {
+            for(auto c = 0; c < alphabet_size; ++c) {
+                const auto t = next(s, c);
+                if(predecessors[t].empty() || predecessors[t].back() != s) {
+                    predecessors[t].push_back(s);
+                }
+            }
+        }
+
+        live_.assign(size(), false);
+        std::stack<state_t> to_process;
+        for(state_t s = 0; s < size(); ++s) {
+            if(is_accepting(s)) {
+                live_[s] = true;
+                to_process.push(s);
+            }
+        }
+        while(!to_process.empty()) {
+            const auto t = to_process.top();
+            to_process.pop();
+            for(const auto s : predecessors[t]) {
+                if(!live_[s]) {
+                    live_[s] = true;
+                    to_process.push(s);
+                }
+            }
+        }
+    }
+
+    void compute_terminal_states()
+    {
+        // A state accepts regardless of the rest of the input if it accepts
+        // and all of its transitions lead to such states. Start out assuming
+        // all accepting states do and remove the ones that violate this until
+        // there are none left.
+        std::vector<char> accepts_always(size());
+        for(state_t s = 0; s < size(); ++s) {
+            accepts_always[s] = is_accepting(s);
+        }
+        bool has_changed = true;
+        while(has_changed) {
+            has_changed = false;
+            for(state_t s = 0; s < size(); ++s) {
+                if(!accepts_always[s]) { continue; }
+                for(auto c = 0; c < alphabet_size; ++c) {
+                    if(!accepts_always[next(s, c)]) {
+                        accepts_always[s] = false;
+                        has_changed = true;
+                        break;
+                    }
+                }
+            }
+        }
+
+        terminal_.resize(size());
+        for(state_t s = 0; s < size(); ++s) {
+            terminal_[s] = !is_live(s) || accepts_always[s];
+        }
+    }
+};
+
+/**
+ * The entire state of a stream that is being matched against a frozen DFA.
+ * It is a plain 4-byte value so that callers multiplexing a large number of
+ * streams (e.g. network flows) can store it in their own tables instead of
+ * keeping a matcher object around per stream. Whether the stream matches so
+ * far, or may still match, follows from the DFA state itself.
+ */
+struct stream_state
+{
+    static constexpr int serialized_size = 4;
+
+    state_t state;
+
+    /** Writes the state to `out` in a fixed, little-endian layout. */
+    void serialize(unsigned char* out) const noexcept
+    {
+        const auto s = static_cast<std::uint32_t>(state);
+        for(auto i = 0; i < serialized_size; ++i) {
+            out[i] = (s >> (8 * i)) & 0xff;
+        }
+    }
+
+    static stream_state deserialize(const unsigned char* in) noexcept
+    {
+        std::uint32_t s = 0;
+        for(auto i = 0; i < serialized_size; ++i) {
+            s |= std::uint32_t(in[i]) << (8 * i);
+        }
+        return {static_cast<state_t>(s)};
+    }
+};
+
+static_assert(sizeof(stream_state) == stream_state::serialized_size);
+
+/** Returns the state of a stream from which no input has been consumed yet. */
+inline stream_state start_stream(const frozen_dfa& dfa) noexcept
+{
+    return {dfa.start_state()};
+}
+
+/**
+ * Resumes matching a stream from `state`, which must have been obtained from
+ * the same DFA, by consuming `packet`, and returns whether the stream's input
+ * so far is matched by the DFA.
+ */
+inline result scan(const frozen_dfa& dfa, stream_state& state, std::string_view packet) noexcept
+{
+    assert(dfa.is_legal_state(state.state));
+    state.state = dfa.step(state.state, packet);
+    return dfa.is_accepting(state.state) ? result::accept : result::reject;
+}
+
+/**
+ * Like `scan` but returns result::partial if the stream's input so far is not
+ * matched but could still be by future packets, and stops consuming `packet`
+ * once no future packet can lead to a match anymore.
+ */
+inline result scan_prefix(const frozen_dfa& dfa, stream_state& state, std::string_view packet) noexcept
+{
+    assert(dfa.is_legal_state(state.state));
+    state.state = dfa.step(state.state, packet);
+    return dfa.classify(state.state);
+}
+
+/**
+ * Simulates a frozen DFA over input that arrives in chunks, such that feeding
+ * an input piecemeal yields the same result as simulating it in one go.
+ */
+class stream_matcher
+{
+    const frozen_dfa* dfa_;
+    stream_state state_;
+
+public:
+    explicit stream_matcher(const frozen_dfa& dfa)
+        : dfa_(&dfa)
+        , state_(start_stream(dfa))
+    {}
+
+    void feed(std::string_view chunk) noexcept
+    {
+        scan(*dfa_, state_, chunk);
+    }
+
+    /** Returns whether the input fed so far is matched by the DFA. */
+    result status() const noexcept
+    {
+        return dfa_->is_accepting(state_.state) ? result::accept : result::reject;
+    }
+
+    /** Returns whether no further input can change `status()`. */
+    bool is_decided() const noexcept { return dfa_->is_terminal(state_.state); }
+
+    const stream_state& state() const noexcept { return state_; }
+
+    void reset() noexcept { state_ = start_stream(*dfa_); }
+};
+
+/**
+ * Simulates a frozen DFA over a batch of inputs, keeping the state after each
+ * byte of the previous input, so that each input is only stepped from where
+ * it stops sharing a prefix with the previous one. When the inputs are sorted,
+ * e.g. URLs or keys, neighbours share long prefixes and each input mostly
+ * costs its distinct suffix.
+ */
+class prefix_matcher
+{
+    const frozen_dfa* dfa_;
+    // The consumed prefix of the previous input, and the states after each
+    // of its prefixes, so `states_` has one more entry. Since no input can
+    // change the outcome past a terminal state, the previous input is only
+    // kept up to where one is reached.
+    std::string previous_;
+    std::vector<state_t> states_;
+
+public:
+    explicit prefix_matcher(const frozen_dfa& dfa)
+        : dfa_(&dfa)
+        , states_{dfa.start_state()}
+    {}
+
+    /** Returns the state reached from the start on `input`, see `frozen_dfa::step`. */
+    state_t step(std::string_view input)
+    {
+        const auto common = std::mismatch(previous_.begin(), previous_.end(), input.begin(), input.end());
+        const std::size_t depth = common.first - previous_.begin();
+        previous_.resize(depth);
+        states_.resize(depth + 1);
+
+        auto s = states_.back();
+        for(auto i = depth; i < input.size() && !dfa_->is_terminal(s); ++i) {
+            s = dfa_->next(s, input[i]);
+            previous_ += input[i];
+            states_.push_back(s);
+        }
+        return s;
+    }
+
+    /** Same as `frozen_dfa::simulate`. */
+    result simulate(std::string_view input)
+    {
+        return dfa_->is_accepting(step(input)) ? result::accept : result::reject;
+    }
+
+    /** Same as `frozen_dfa::simulate_prefix`. */
+    result simulate_prefix(std::string_view input)
+    {
+        return dfa_->classify(step(input));
+    }
+
+    void reset() noexcept
+    {
+        previous_.clear();
+        states_.resize(1);
+    }
+};
+
 } // fsm
 
 #endif
@@ -0,0 +1,204 @@
+#ifndef GENERATOR_HEADER
+#define GENERATOR_HEADER
+
+#ifdef __cpp_impl_coroutine
+
+#include <coroutine>
+#include <exception>
+#include <iterator>
+#include <utility>
+#include <memory>
+#include <array>
+#include <new>
+#include <cstddef>
+
+namespace generator {
+
+/**
+ * A thread-local pool of coroutine frames. Frames are binned by size and
+ * freed frames are kept for reuse, so that repeatedly creating generators of
+ * the same kind doesn't hit the allocator after the first one.
+ */
+class frame_pool
+{
+    static constexpr std::size_t granularity = 64;
+    static constexpr std::size_t num_bins = 16;
+
+    struct free_frame { free_frame* next; };
+    std::array<free_frame*, num_bins> free_lists_{};
+
+public:
+    static frame_pool& local() noexcept
+    {
+        thread_local frame_pool pool;
+        return pool;
+    }
+
+    frame_pool() = default;
+    frame_pool(const frame_pool&) = delete;
+    frame_pool& operator=(const frame_pool&) = delete;
+
+    ~frame_pool()
+    {
+        for(auto* frame : free_lists_) {
+            while(frame) {
+                auto* next = frame->next;
+                ::operator delete(frame);
+                frame = next;
+            }
+        }
+    }
+
+    void* allocate(const std::size_t size)
+    {
+        const auto bin = bin_of(size);
+        if(bin >= num_bins) {
+            return ::operator new(size);
+        }
+        if(auto* frame = free_lists_[bin]) {
+            free_lists_[bin] = frame->next;
+            return frame;
+        }
+        return ::operator new((bin + 1) * granularity);
+    }
+
+    void deallocate(void* p, const std::size_t size) noexcept
+    {
+        const auto bin = bin_of(size);
+        if(bin >= num_bins) {
+            ::operator delete(p);
+            return;
+        }
+        free_lists_[bin] = ::new(p) free_frame{free_lists_[bin]};
+    }
+
+private:
+    static std::size_t bin_of(const std::size_t size) noexcept
+    {
+        return (size + granularity - 1) / granularity - 1;
+    }
+};
+
+/**
+ * A lazily evaluated sequence of values produced by a coroutine that
+ * `co_yield`s them one at a time. The coroutine only runs as far as the
+ * consumer iterates, so it can be abandoned at any point.
+ */
+template<typename T>
+class generator
+{
+public:
+    struct promise_type
+    {
+        const T* value;
+        std::exception_ptr exception;
+
+        generator get_return_object() noexcept
+        {
+            return generator(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        std::suspend_always initial_suspend() const noexcept { return {}; }
+        std::suspend_always final_suspend() const noexcept { return {}; }
+
+        std::suspend_always yield_value(const T& v) noexcept
+        {
+            value = std::addressof(v);
+            return {};
+        }
+
+        void return_void() const noexcept {}
+        void unhandled_exception() noexcept { exception = std::current_exception(); }
+
+        static void* operator new(const std::size_t size)
+        {
+            return frame_pool::local().allocate(size);
+        }
+
+        static void operator delete(void* p, const std::size_t size) noexcept
+        {
+            frame_pool::local().deallocate(p, size);
+        }
+    };
+
+    class iterator
+    {
+        std::coroutine_handle<promise_type> coro_;
+
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const T*;
+        using reference = const T&;
+
+        iterator() = default;
+        explicit iterator(std::coroutine_handle<promise_type> coro) noexcept : coro_(coro) {}
+
+        reference operator*() const noexcept { return *coro_.promise().value; }
+        pointer operator->() const noexcept { return coro_.promise().value; }
+
+        iterator& operator++()
+        {
+            resume(coro_);
+            return *this;
+        }
+
+        void operator++(int) { ++*this; }
+
+        friend bool operator==(const iterator& it, std::default_sentinel_t) noexcept
+        {
+            return !it.coro_ || it.coro_.done();
+        }
+        friend bool operator!=(const iterator& it, std::default_sentinel_t s) noexcept
+        {
+            return !(it == s);
+        }
+    };
+
+private:
+    std::coroutine_handle<promise_type> coro_;
+
+public:
+    generator(generator&& other) noexcept : coro_(std::exchange(other.coro_, {})) {}
+
+    generator& operator=(generator&& other) noexcept
+    {
+        if(this != &other) {
+            if(coro_) { coro_.destroy(); }
+            coro_ = std::exchange(other.coro_, {});
+        }
+        return *this;
+    }
+
+    ~generator()
+    {
+        if(coro_) { coro_.destroy(); }
+    }
+
+    /** Runs the coroutine up to its first value. May only be called once. */
+    iterator begin()
+    {
+        resume(coro_);
+        return iterator(coro_);
+    }
+
+    std::default_sentinel_t end() const noexcept { return {}; }
+
+private:
+    explicit generator(std::coroutine_handle<promise_type> coro) noexcept : coro_(coro) {}
+
+    static void resume(std::coroutine_handle<promise_type> coro)
+    {
+        coro.resume();
+        if(coro.promise().exception) {
+            std::rethrow_exception(coro.promise().exception);
+        }
+    }
+};
+
+} // generator
+
+#endif // __cpp_impl_coroutine
+
+#endif
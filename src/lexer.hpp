@@ -0,0 +1,98 @@
+#ifndef LEXER_HEADER
+#define LEXER_HEADER
+
+#include <string_view>
+#include <vector>
+#include <optional>
+#include <type_traits>
+#include <cstddef>
+
+#include "fsm.hpp"
+#include "regex.hpp"
+
+namespace lexer {
+
+struct rule
+{
+    int token_id;
+    std::string_view regex;
+};
+
+struct token
+{
+    int id;
+    regex::span span;
+};
+
+/**
+ * A maximal-munch lexer: all rules are compiled into a single DFA whose
+ * accepting states are tagged with the first rule they accept, and at each
+ * position the longest match of any rule is taken, ties being broken in
+ * favor of the rule listed first. The input is consumed only until the DFA
+ * dies, after which lexing resumes from the last accepting position.
+ */
+class lexer
+{
+    fsm::frozen_dfa dfa_;
+    std::vector<int> token_ids_;
+
+public:
+    explicit lexer(const std::vector<rule>& rules)
+        : dfa_([&rules] {
+            std::vector<fsm::frozen_dfa> dfas;
+            for(const auto& rule : rules) {
+                dfas.push_back(regex::compile(rule.regex));
+            }
+            return fsm::frozen_dfa::combine(dfas);
+        }())
+    {
+        for(const auto& rule : rules) {
+            token_ids_.push_back(rule.token_id);
+        }
+    }
+
+    /**
+     * Returns the longest non-empty token at `offset`, or nothing if no rule
+     * matches there.
+     */
+    std::optional<token> next(std::string_view input, const std::size_t offset) const noexcept
+    {
+        std::optional<token> longest;
+        auto s = dfa_.start_state();
+        for(auto pos = offset; pos < input.size() && dfa_.is_live(s);) {
+            s = dfa_.next(s, input[pos]);
+            ++pos;
+            if(dfa_.is_accepting(s)) {
+                longest = token{token_ids_[dfa_.accepted_pattern(s)], {offset, pos}};
+            }
+        }
+        return longest;
+    }
+
+    /**
+     * Invokes `on_token(const token&)` for each token of `input` in order and
+     * returns the offset at which lexing stopped, which is the size of the
+     * input unless no rule matches at that offset. If `on_token` returns
+     * a value, lexing stops as soon as it returns false.
+     */
+    template<typename OnToken>
+    std::size_t tokenize(std::string_view input, OnToken&& on_token) const
+    {
+        std::size_t offset = 0;
+        while(offset < input.size()) {
+            const auto t = next(input, offset);
+            if(!t) { break; }
+            offset = t->span.end;
+            if constexpr(std::is_void_v<std::invoke_result_t<OnToken&, const token&>>) {
+                on_token(*t);
+            } else {
+                if(!on_token(*t)) { break; }
+            }
+        }
+        return offset;
+    }
+};
+
+} // lexer
+
+#endif
@@ -9,6 +9,7 @@
 
 #include "fsm.hpp"
 #include "thompson.hpp"
+#include "utf8.hpp"
 
 namespace parser {
 
@@ -50,7 +51,8 @@ public:
             return output_.back();
         }
 
-        for(const auto c : regex_) {
+        for(std::size_t i = 0; i < regex_.size(); ++i) {
+            const auto c = regex_[i];
             switch(c) {
             case '(':
                 op_stack_.push(op::left_paren);
@@ -94,18 +96,21 @@ public:
                 op_stack_.push(op::alternation);
                 is_prev_separator_ = true;
                 break;
-            default:
-                auto literal = thompson::build_literal(c);
-                if(is_prev_separator_) {
-                    output_.emplace_back(std::move(literal));
-                    is_prev_separator_ = false;
-                } else {
-                    if(output_.empty()) {
-                        output_.emplace_back(literal);
-                    } else {
-                        output_.back() = thompson::build_concatenation(output_.back(), literal);
-                    }
+            case '.':
+                add_operand(utf8::build_any());
+                break;
+            case '[':
+                add_operand(parse_class(i));
+                break;
+            case '\\':
+                if(++i == regex_.size()) {
+                    throw std::runtime_error("\\ must be followed by a character");
                 }
+                add_operand(utf8::build_code_point(decode(i)));
+                break;
+            default:
+                // Multibyte code points are matched byte by byte.
+                add_operand(thompson::build_literal(static_cast<unsigned char>(c)));
             }
         }
 
@@ -123,6 +128,76 @@ public:
     }
 
 private:
+    void add_operand(fsm::nfa operand)
+    {
+        if(is_prev_separator_) {
+            output_.emplace_back(std::move(operand));
+            is_prev_separator_ = false;
+        } else {
+            if(output_.empty()) {
+                output_.emplace_back(std::move(operand));
+            } else {
+                output_.back() = thompson::build_concatenation(output_.back(), operand);
+            }
+        }
+    }
+
+    /**
+     * Decodes the code point at `i` and leaves `i` at its last byte, as the
+     * main loop advances it past that.
+     */
+    char32_t decode(std::size_t& i) const
+    {
+        const auto cp = utf8::decode(regex_, i);
+        --i;
+        return cp;
+    }
+
+    /**
+     * Parses a class such as `[a-zä]` or `[^0-9]`, `i` being the index of the
+     * opening bracket, which is left at the closing bracket. Within a class,
+     * `\` escapes the next character.
+     */
+    fsm::nfa parse_class(std::size_t& i)
+    {
+        const auto next_code_point = [this, &i] {
+            if(++i == regex_.size()) {
+                throw std::runtime_error("unterminated character class");
+            }
+            if(regex_[i] == '\\' && ++i == regex_.size()) {
+                throw std::runtime_error("unterminated character class");
+            }
+            return decode(i);
+        };
+
+        const auto negate = i + 1 < regex_.size() && regex_[i + 1] == '^';
+        if(negate) { ++i; }
+        std::vector<utf8::range> ranges;
+        while(i + 1 < regex_.size() && regex_[i + 1] != ']') {
+            const auto first = next_code_point();
+            auto last = first;
+            if(i + 2 < regex_.size() && regex_[i + 1] == '-' && regex_[i + 2] != ']') {
+                ++i;
+                last = next_code_point();
+            }
+            if(first > last) {
+                throw std::runtime_error("invalid range in character class");
+            }
+            ranges.push_back({first, last});
+        }
+        if(++i >= regex_.size()) {
+            throw std::runtime_error("unterminated character class");
+        }
+        if(ranges.empty()) {
+            throw std::runtime_error("empty character class");
+        }
+        if(negate) {
+            // NUL can't be matched (see `utf8::build_class`).
+            ranges.push_back({0, 0});
+        }
+        return utf8::build_class(utf8::normalize(std::move(ranges), negate));
+    }
+
     void build_alternation()
     {
         if(output_.size() < 2) {
@@ -0,0 +1,245 @@
+#ifndef PIPELINE_HEADER
+#define PIPELINE_HEADER
+
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <vector>
+#include <optional>
+#include <stdexcept>
+#include <cstdint>
+
+#include "fsm.hpp"
+#include "utf8.hpp"
+
+namespace pipeline {
+
+/**
+ * A bounded, lock-free ring buffer for exactly one producer and exactly one
+ * consumer thread. The capacity is rounded up to a power of two.
+ */
+template<typename T>
+class spsc_ring
+{
+    static constexpr std::size_t cache_line_size = 64;
+
+    std::unique_ptr<T[]> slots_;
+    std::size_t mask_;
+
+    // The consumer's and the producer's indices live on separate cache lines
+    // so that the two threads don't invalidate each other's cache on every
+    // operation. Each side also keeps a cached copy of the other side's index
+    // and only reloads it when the ring appears to be empty or full.
+    alignas(cache_line_size) std::atomic<std::size_t> head_{0};
+    std::size_t cached_tail_ = 0;
+    alignas(cache_line_size) std::atomic<std::size_t> tail_{0};
+    std::size_t cached_head_ = 0;
+
+public:
+    explicit spsc_ring(const std::size_t capacity)
+    {
+        if(capacity < 1) {
+            throw std::invalid_argument("capacity must be larger than zero");
+        }
+        std::size_t n = 1;
+        while(n < capacity) { n *= 2; }
+        slots_.reset(new T[n]);
+        mask_ = n - 1;
+    }
+
+    std::size_t capacity() const noexcept { return mask_ + 1; }
+
+    /** Must only be called by the producer. Returns false if the ring is full. */
+    bool try_push(T value) noexcept
+    {
+        const auto tail = tail_.load(std::memory_order_relaxed);
+        if(tail - cached_head_ == capacity()) {
+            cached_head_ = head_.load(std::memory_order_acquire);
+            if(tail - cached_head_ == capacity()) { return false; }
+        }
+        slots_[tail & mask_] = std::move(value);
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Must only be called by the consumer. Returns false if the ring is empty. */
+    bool try_pop(T& value) noexcept
+    {
+        const auto head = head_.load(std::memory_order_relaxed);
+        if(head == cached_tail_) {
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+            if(head == cached_tail_) { return false; }
+        }
+        value = std::move(slots_[head & mask_]);
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+/** A pooled buffer handed between the pipeline's stages by pointer. */
+struct buffer
+{
+    char* data;
+    std::size_t capacity;
+    std::size_t size;
+    std::uint64_t sequence;
+};
+
+struct match_record
+{
+    /** The position of the record in the order it was read. */
+    std::uint64_t sequence;
+    fsm::result result;
+    /**
+     * If UTF-8 validation is enabled, the offset of the record's first
+     * invalid sequence, if any, in which case the result is reject.
+     */
+    std::optional<std::size_t> invalid_utf8_offset;
+};
+
+struct options
+{
+    int num_matchers = 1;
+    /** Bounds the number of records in flight per matcher stage. */
+    int buffers_per_matcher = 16;
+    std::size_t buffer_size = 64 * 1024;
+    /**
+     * Whether matchers also validate that records are UTF-8, in the same pass
+     * (see `utf8::validating_matcher`).
+     */
+    bool validate_utf8 = false;
+};
+
+/**
+ * Runs a reader -> N matchers -> sink pipeline over a frozen DFA.
+ *
+ * `reader(char* data, std::size_t capacity)` is invoked on a dedicated thread
+ * to fill a pooled buffer with a single record and returns its length, or
+ * zero once the input is exhausted. Each record is then simulated by one of
+ * `opts.num_matchers` matcher threads and `sink(const match_record&)` is
+ * invoked with the result on the calling thread. Records from different
+ * matchers may reach the sink out of order, which is what their sequence
+ * numbers are for. Neither callback may throw.
+ *
+ * Stages are connected by SPSC rings: the reader hands buffers to matcher i
+ * through its work ring and matcher i returns them to the reader through its
+ * free ring as soon as the DFA has run, so records are never copied and
+ * nothing is allocated once the pipeline is running. If all buffers are in
+ * use, the reader waits for one to be recycled, and if the sink falls behind,
+ * the matchers wait for room in their result rings.
+ */
+template<typename Reader, typename Sink>
+void run(const fsm::frozen_dfa& dfa, const options& opts, Reader&& reader, Sink&& sink)
+{
+    if(opts.num_matchers < 1 || opts.buffers_per_matcher < 1 || opts.buffer_size < 1) {
+        throw std::invalid_argument("pipeline options must be larger than zero");
+    }
+
+    struct matcher_stage
+    {
+        spsc_ring<buffer*> work;
+        spsc_ring<buffer*> free;
+        spsc_ring<match_record> results;
+        std::atomic<bool> is_done{false};
+
+        explicit matcher_stage(const std::size_t n) : work(n), free(n), results(n) {}
+    };
+
+    const auto num_matchers = opts.num_matchers;
+    const std::size_t num_buffers = opts.buffers_per_matcher;
+    std::unique_ptr<char[]> storage(new char[num_matchers * num_buffers * opts.buffer_size]);
+    std::vector<buffer> buffers(num_matchers * num_buffers);
+    std::vector<std::unique_ptr<matcher_stage>> stages;
+    for(auto i = 0; i < num_matchers; ++i) {
+        stages.emplace_back(std::make_unique<matcher_stage>(num_buffers));
+        for(std::size_t j = 0; j < num_buffers; ++j) {
+            auto& b = buffers[i * num_buffers + j];
+            b = buffer{storage.get() + (i * num_buffers + j) * opts.buffer_size,
+                opts.buffer_size, 0, 0};
+            stages.back()->free.try_push(&b);
+        }
+    }
+    std::atomic<bool> is_reader_done{false};
+
+    std::thread reader_thread([&] {
+        std::uint64_t sequence = 0;
+        int next = 0;
+        while(true) {
+            // Hand the record to the first matcher, starting after the one
+            // that got the previous record, that has a free buffer.
+            buffer* b = nullptr;
+            while(!stages[next]->free.try_pop(b)) {
+                next = (next + 1) % num_matchers;
+                if(next == 0) { std::this_thread::yield(); }
+            }
+            b->size = reader(b->data, b->capacity);
+            // The buffer isn't handed back on the free ring, which only the
+            // matcher may push to.
+            if(b->size == 0) { break; }
+            b->sequence = sequence++;
+            // The work ring has room for every buffer the matcher owns.
+            stages[next]->work.try_push(b);
+            next = (next + 1) % num_matchers;
+        }
+        is_reader_done.store(true, std::memory_order_release);
+    });
+
+    std::vector<std::thread> matcher_threads;
+    for(auto i = 0; i < num_matchers; ++i) {
+        matcher_threads.emplace_back([&dfa, &opts, &is_reader_done, &stage = *stages[i]] {
+            utf8::validating_matcher validating_matcher(dfa);
+            while(true) {
+                buffer* b;
+                if(!stage.work.try_pop(b)) {
+                    if(!is_reader_done.load(std::memory_order_acquire)) {
+                        std::this_thread::yield();
+                        continue;
+                    }
+                    // Only stop once the ring has been drained after the
+                    // reader had finished pushing.
+                    if(!stage.work.try_pop(b)) { break; }
+                }
+                const std::string_view data(b->data, b->size);
+                match_record record{b->sequence, fsm::result::reject, std::nullopt};
+                if(opts.validate_utf8) {
+                    validating_matcher.reset();
+                    validating_matcher.feed(data);
+                    record.result = validating_matcher.finish();
+                    record.invalid_utf8_offset = validating_matcher.error_offset();
+                } else {
+                    record.result = dfa.simulate(data);
+                }
+                stage.free.try_push(b);
+                while(!stage.results.try_push(record)) {
+                    std::this_thread::yield();
+                }
+            }
+            stage.is_done.store(true, std::memory_order_release);
+        });
+    }
+
+    auto num_active = num_matchers;
+    while(num_active > 0) {
+        bool has_progressed = false;
+        num_active = 0;
+        for(auto& stage : stages) {
+            const bool was_done = stage->is_done.load(std::memory_order_acquire);
+            match_record record;
+            while(stage->results.try_pop(record)) {
+                sink(record);
+                has_progressed = true;
+            }
+            if(!was_done) { ++num_active; }
+        }
+        if(!has_progressed) { std::this_thread::yield(); }
+    }
+
+    reader_thread.join();
+    for(auto& t : matcher_threads) {
+        t.join();
+    }
+}
+
+} // pipeline
+
+#endif
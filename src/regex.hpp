@@ -0,0 +1,525 @@
+#ifndef REGEX_HEADER
+#define REGEX_HEADER
+
+#include <string_view>
+#include <algorithm>
+#include <optional>
+#include <iterator>
+#include <type_traits>
+#include <vector>
+#include <cstddef>
+
+#include <sys/uio.h>
+
+#include "fsm.hpp"
+#include "parser.hpp"
+#include "generator.hpp"
+
+namespace regex {
+
+/** A match's position in the input as a half-open range of byte offsets. */
+struct span
+{
+    std::size_t begin;
+    std::size_t end;
+
+    std::size_t size() const noexcept { return end - begin; }
+
+    friend bool operator==(const span& a, const span& b) noexcept
+    {
+        return a.begin == b.begin && a.end == b.end;
+    }
+    friend bool operator!=(const span& a, const span& b) noexcept { return !(a == b); }
+};
+
+inline std::string_view as_string_view(std::string_view s) noexcept { return s; }
+
+inline std::string_view as_string_view(const iovec& v) noexcept
+{
+    return {static_cast<const char*>(v.iov_base), v.iov_len};
+}
+
+/**
+ * Caller-owned arrays that matches are written to in structure-of-arrays
+ * layout: the i-th match is `[begins[i], ends[i])` and matches pattern
+ * `pattern_ids[i]`. Each array must have room for `capacity` elements.
+ */
+struct match_buffers
+{
+    std::size_t* begins;
+    std::size_t* ends;
+    int* pattern_ids;
+    std::size_t capacity;
+};
+
+/** Records where `pattern::find_all` is to resume scanning an input. */
+struct continuation
+{
+    std::size_t offset = 0;
+    bool is_done = false;
+};
+
+namespace detail {
+
+/** Iterates over the bytes of a contiguous input. */
+class contiguous_cursor
+{
+    const char* begin_;
+    const char* pos_;
+    const char* end_;
+
+public:
+    contiguous_cursor(std::string_view input, const std::size_t offset) noexcept
+        : begin_(input.data())
+        , pos_(input.data() + offset)
+        , end_(input.data() + input.size())
+    {}
+
+    bool at_end() const noexcept { return pos_ == end_; }
+    unsigned char operator*() const noexcept { return *pos_; }
+    void operator++() noexcept { ++pos_; }
+    void operator--() noexcept { --pos_; }
+    std::size_t position() const noexcept { return pos_ - begin_; }
+};
+
+/**
+ * Iterates over the bytes of an input made up of a sequence of segments as if
+ * they were a single contiguous input, without copying them.
+ */
+template<typename SegmentIt>
+class segmented_cursor
+{
+    SegmentIt first_;
+    SegmentIt segment_;
+    SegmentIt last_;
+    std::string_view current_;
+    std::size_t offset_ = 0;
+    std::size_t position_ = 0;
+
+public:
+    segmented_cursor(SegmentIt first, SegmentIt last, std::size_t offset)
+        : first_(first)
+        , segment_(first)
+        , last_(last)
+    {
+        skip_exhausted_segments();
+        while(offset > 0 && !at_end()) {
+            const auto n = std::min(offset, current_.size() - offset_);
+            offset_ += n;
+            position_ += n;
+            offset -= n;
+            skip_exhausted_segments();
+        }
+    }
+
+    bool at_end() const noexcept { return segment_ == last_; }
+    unsigned char operator*() const noexcept { return current_[offset_]; }
+
+    void operator++() noexcept
+    {
+        ++offset_;
+        ++position_;
+        skip_exhausted_segments();
+    }
+
+    /** Must not be called at the start of the input. */
+    void operator--() noexcept
+    {
+        assert(position_ > 0);
+        --position_;
+        // Step back over exhausted (and empty) segments.
+        while(offset_ == 0) {
+            assert(segment_ != first_);
+            --segment_;
+            current_ = as_string_view(*segment_);
+            offset_ = current_.size();
+        }
+        --offset_;
+    }
+
+    std::size_t position() const noexcept { return position_; }
+
+private:
+    void skip_exhausted_segments() noexcept
+    {
+        while(segment_ != last_) {
+            current_ = as_string_view(*segment_);
+            if(offset_ < current_.size()) { return; }
+            ++segment_;
+            offset_ = 0;
+        }
+    }
+};
+
+template<typename Segments>
+using is_segmented = std::negation<std::is_convertible<const Segments&, std::string_view>>;
+
+/** A match along with the id of the pattern it matches. */
+struct found
+{
+    regex::span span;
+    int pattern_id;
+};
+
+template<typename Segments>
+auto make_cursor(const Segments& segments, const std::size_t offset)
+{
+    using std::begin;
+    using std::end;
+    return segmented_cursor<decltype(begin(segments))>(begin(segments), end(segments), offset);
+}
+
+} // detail
+
+inline fsm::frozen_dfa compile(std::string_view regex)
+{
+    const auto nfa = parser::shunting_yard_nfa_parser(regex).parse();
+    return fsm::frozen_dfa(fsm::dfa(nfa, fsm::derive_input_language(nfa)));
+}
+
+/**
+ * A compiled regular expression, or a set of them that are matched at once.
+ * Besides the DFA matching the whole input, it keeps an unanchored DFA with
+ * which the input can be skimmed for the end of the first match without
+ * considering where matches may start.
+ *
+ * Each regex in a set is identified by its index, which is also its priority:
+ * if several regexes match the same span, the one with the lowest index is
+ * reported.
+ */
+class pattern
+{
+    fsm::frozen_dfa anchored_;
+    fsm::frozen_dfa search_;
+    // See `find_from`. Missing if it would have been too large.
+    std::optional<fsm::frozen_dfa> reverse_;
+
+public:
+    explicit pattern(std::string_view regex) : pattern(compile(regex)) {}
+
+    explicit pattern(const std::vector<std::string_view>& regexes)
+        : pattern([&regexes] {
+            std::vector<fsm::frozen_dfa> dfas;
+            for(const auto regex : regexes) {
+                dfas.push_back(compile(regex));
+            }
+            return fsm::frozen_dfa::combine(dfas);
+        }())
+    {}
+
+    explicit pattern(const fsm::dfa& dfa) : pattern(fsm::frozen_dfa(dfa)) {}
+
+    /** `anchored` must be a full match mode DFA. */
+    explicit pattern(fsm::frozen_dfa anchored)
+        : anchored_(std::move(anchored))
+        , search_(fsm::frozen_dfa::combine({anchored_}, fsm::match_mode::search))
+        , reverse_(fsm::frozen_dfa::reverse_prefixes(anchored_, max_reverse_states()))
+    {}
+
+    const fsm::frozen_dfa& anchored_dfa() const noexcept { return anchored_; }
+    const fsm::frozen_dfa& search_dfa() const noexcept { return search_; }
+
+    /** Returns whether the whole input is matched. */
+    bool match(std::string_view input) const noexcept
+    {
+        return anchored_.simulate(input) == fsm::result::accept;
+    }
+
+    /**
+     * Returns whether the concatenation of `segments` is matched. `segments`
+     * may be any range of `iovec`s or of types convertible to
+     * `std::string_view`.
+     */
+    template<typename Segments,
+        typename = std::enable_if_t<detail::is_segmented<Segments>::value>>
+    bool match(const Segments& segments) const noexcept
+    {
+        auto s = anchored_.start_state();
+        for(const auto& segment : segments) {
+            s = anchored_.step(s, as_string_view(segment));
+        }
+        return anchored_.is_accepting(s);
+    }
+
+    /**
+     * Returns the leftmost-longest match in `input` that starts at or after
+     * `offset`, if any.
+     */
+    std::optional<span> find(std::string_view input, const std::size_t offset = 0) const noexcept
+    {
+        const auto found = find_at(input, offset);
+        if(!found) { return {}; }
+        return found->span;
+    }
+
+    /**
+     * Same as the above, but over the concatenation of `segments`, and the
+     * match is reported in offsets into this concatenation.
+     */
+    template<typename Segments,
+        typename = std::enable_if_t<detail::is_segmented<Segments>::value>>
+    std::optional<span> find(const Segments& segments, const std::size_t offset = 0) const
+    {
+        const auto cursor = detail::make_cursor(segments, offset);
+        if(cursor.position() != offset) { return {}; }
+        const auto found = find_from(cursor);
+        if(!found) { return {}; }
+        return found->span;
+    }
+
+    /**
+     * Invokes `on_match(int pattern_id, std::size_t begin, std::size_t end)`
+     * for each leftmost-longest, non-overlapping match in `input` as soon as
+     * it's found, without materializing the matches. If `on_match` returns
+     * a value, the scan stops as soon as it returns false. To only count
+     * the matches, see `count_earliest`, which is faster but counts
+     * earliest-ending rather than leftmost-longest matches.
+     */
+    template<typename OnMatch>
+    void scan(std::string_view input, OnMatch&& on_match) const
+    {
+        std::size_t offset = 0;
+        while(const auto found = find_at(input, offset)) {
+            const auto [begin, end] = found->span;
+            using return_type = std::invoke_result_t<OnMatch&, int, std::size_t, std::size_t>;
+            if constexpr(std::is_void_v<return_type>) {
+                on_match(found->pattern_id, begin, end);
+            } else {
+                if(!on_match(found->pattern_id, begin, end)) { return; }
+            }
+            offset = next_offset(found->span);
+        }
+    }
+
+    /**
+     * Returns the offset from which to look for the match after `match`,
+     * which is right after it, or after its position if it's empty so that
+     * the same empty match isn't reported forever.
+     */
+    static std::size_t next_offset(const span& match) noexcept
+    {
+        return match.end + (match.size() == 0);
+    }
+
+    /** Returns whether `input` contains a match. */
+    bool contains(std::string_view input) const noexcept
+    {
+        return search_.simulate(input) == fsm::result::accept;
+    }
+
+    /**
+     * Returns for each of `inputs` whether it's matched as a whole, like
+     * `match`. Each input is only matched from where it stops sharing
+     * a prefix with the previous one (see `fsm::prefix_matcher`), which pays
+     * off when `inputs` are sorted.
+     */
+    template<typename Inputs>
+    std::vector<bool> match_sorted(const Inputs& inputs) const
+    {
+        return simulate_sorted(anchored_, inputs);
+    }
+
+    /** Same as `match_sorted`, but whether each of `inputs` contains a match. */
+    template<typename Inputs>
+    std::vector<bool> contains_sorted(const Inputs& inputs) const
+    {
+        return simulate_sorted(search_, inputs);
+    }
+
+    /** Returns the number of `records` that contain a match. */
+    template<typename Records>
+    std::size_t count(const Records& records) const noexcept
+    {
+        std::size_t n = 0;
+        for(const auto& record : records) {
+            n += contains(record);
+        }
+        return n;
+    }
+
+    /**
+     * Returns the number of non-overlapping, earliest-ending matches in
+     * `input` without recovering where they start, which makes counting as
+     * fast as deciding whether the input contains a match at all. A match is
+     * counted as soon as it ends and scanning resumes right after it, so
+     * unlike `scan` and `find_all`, which report leftmost-longest matches,
+     * this splits up matches that could be extended (e.g. `b+` yields three
+     * in "abbb" rather than one). Patterns that match the
+     * empty string are counted like `scan` reports them.
+     */
+    std::size_t count_earliest(std::string_view input) const noexcept
+    {
+        const auto start = search_.start_state();
+        if(search_.is_accepting(start)) {
+            // Every position holds an empty match, so the earliest end
+            // semantics above would be meaningless.
+            std::size_t n = 0;
+            scan(input, [&n](int, std::size_t, std::size_t) { ++n; });
+            return n;
+        }
+        std::size_t n = 0;
+        auto s = start;
+        for(const unsigned char c : input) {
+            s = search_.next(s, c);
+            if(search_.is_accepting(s)) {
+                ++n;
+                s = start;
+            }
+        }
+        return n;
+    }
+
+    /**
+     * Writes the leftmost-longest, non-overlapping matches in `input` after
+     * the position recorded in `token` to `out`, without allocating, and
+     * returns their number. If `out` fills up, `token` is updated such that
+     * the next call with it continues where this one left off, otherwise
+     * `token.is_done` is set. E.g.:
+     *
+     *   regex::continuation token;
+     *   while(!token.is_done) {
+     *       const auto n = re.find_all(input, out, token);
+     *       // process the first n matches in out
+     *   }
+     */
+    std::size_t find_all(std::string_view input, const match_buffers& out,
+        continuation& token) const
+    {
+        std::size_t n = 0;
+        while(n < out.capacity) {
+            const auto found = find_at(input, token.offset);
+            if(!found) {
+                token.is_done = true;
+                break;
+            }
+            out.begins[n] = found->span.begin;
+            out.ends[n] = found->span.end;
+            out.pattern_ids[n] = found->pattern_id;
+            ++n;
+            token.offset = next_offset(found->span);
+        }
+        return n;
+    }
+
+#ifdef __cpp_impl_coroutine
+    /**
+     * Lazily yields the leftmost-longest, non-overlapping matches in `input`
+     * one at a time, e.g.:
+     *
+     *   for(const auto match : re.matches(input)) { ... }
+     *
+     * The scan is suspended between matches, with its position kept in the
+     * coroutine frame, so the caller may stop early without the rest of the
+     * input being scanned. Frames are pooled, so after the first call no
+     * allocation is made, neither per call nor per match. `input` and this
+     * pattern must outlive the generator.
+     */
+    generator::generator<span> matches(std::string_view input) const
+    {
+        std::size_t offset = 0;
+        while(const auto match = find(input, offset)) {
+            co_yield *match;
+            offset = next_offset(*match);
+        }
+    }
+#endif
+
+private:
+    template<typename Inputs>
+    static std::vector<bool> simulate_sorted(const fsm::frozen_dfa& dfa, const Inputs& inputs)
+    {
+        fsm::prefix_matcher matcher(dfa);
+        std::vector<bool> results;
+        for(const auto& input : inputs) {
+            results.push_back(matcher.simulate(input) == fsm::result::accept);
+        }
+        return results;
+    }
+
+    /**
+     * The reversed DFA may be exponentially larger than the anchored one,
+     * in which case building it up front would cost every user of the
+     * pattern more than it saves `find`.
+     */
+    int max_reverse_states() const noexcept
+    {
+        return 4 * anchored_.size() + 256;
+    }
+
+    /** Same as `find`, but with the id of the pattern matched. */
+    std::optional<detail::found> find_at(std::string_view input, const std::size_t offset) const noexcept
+    {
+        if(offset > input.size()) { return {}; }
+        return find_from(detail::contiguous_cursor(input, offset));
+    }
+
+    template<typename Cursor>
+    std::optional<detail::found> find_from(const Cursor& from) const
+    {
+        // Find where the first match ends, which bounds where the leftmost
+        // match starts.
+        auto cursor = from;
+        auto s = search_.start_state();
+        while(!search_.is_terminal(s) && !cursor.at_end()) {
+            s = search_.next(s, *cursor);
+            ++cursor;
+        }
+        if(!search_.is_accepting(s)) { return {}; }
+        const auto first_end = cursor.position();
+
+        // No match ends before `first_end`, so a match that starts at
+        // a position before it must run through it, i.e. the input from its
+        // start up to there is a prefix of a match. The leftmost start is thus
+        // among the positions found by scanning back with the reversed DFA of
+        // such prefixes, which includes the start of the match that ends at
+        // `first_end`.
+        // Without that DFA, every position is tried in order instead.
+        auto leftmost = from;
+        if(reverse_) {
+            leftmost = cursor;
+            auto r = reverse_->start_state();
+            for(auto start = cursor; reverse_->is_live(r) && start.position() > from.position();) {
+                --start;
+                r = reverse_->next(r, *start);
+                if(reverse_->is_accepting(r)) {
+                    leftmost = start;
+                }
+            }
+        }
+        if(auto found = longest_match(leftmost)) {
+            return found;
+        }
+
+        // The leftmost prefix wasn't followed by the rest of a match, so try
+        // the positions after it in order.
+        for(auto start = leftmost; start.position() < first_end;) {
+            ++start;
+            if(auto found = longest_match(start)) {
+                return found;
+            }
+        }
+        assert(false && "the search DFA found a match that the anchored DFA didn't");
+        return {};
+    }
+
+    template<typename Cursor>
+    std::optional<detail::found> longest_match(Cursor cursor) const
+    {
+        std::optional<detail::found> found;
+        const auto begin = cursor.position();
+        auto s = anchored_.start_state();
+        while(true) {
+            if(anchored_.is_accepting(s)) {
+                found = detail::found{{begin, cursor.position()}, anchored_.accepted_pattern(s)};
+            }
+            if(!anchored_.is_live(s) || cursor.at_end()) { break; }
+            s = anchored_.next(s, *cursor);
+            ++cursor;
+        }
+        return found;
+    }
+};
+
+} // regex
+
+#endif
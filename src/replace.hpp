@@ -0,0 +1,118 @@
+#ifndef REPLACE_HEADER
+#define REPLACE_HEADER
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstring>
+#include <cassert>
+
+#include "regex.hpp"
+
+namespace replace {
+
+/**
+ * Replaces all leftmost-longest, non-overlapping matches of a pattern in an
+ * input in two phases: `prepare` scans the input once, remembering the
+ * matches, and returns the exact size of the output, which `write` then
+ * assembles from bulk copies of the unmatched regions and the replacement.
+ * The buffer of matches is kept across calls, so a replacer that is reused
+ * stops allocating once it has seen the largest number of matches.
+ */
+class replacer
+{
+    std::vector<regex::span> matches_;
+    std::string_view input_;
+    std::string_view replacement_;
+    std::size_t output_size_ = 0;
+
+public:
+    /**
+     * Scans `input` for matches of `pattern` and returns the size of the
+     * output of replacing each with `replacement`. Both `input` and
+     * `replacement` must stay valid until `write` is called.
+     */
+    std::size_t prepare(const regex::pattern& pattern, std::string_view input,
+        std::string_view replacement)
+    {
+        matches_.clear();
+        input_ = input;
+        replacement_ = replacement;
+        std::size_t matched_size = 0;
+        pattern.scan(input, [this, &matched_size](int, std::size_t begin, std::size_t end) {
+            matches_.push_back({begin, end});
+            matched_size += end - begin;
+        });
+        output_size_ = input.size() - matched_size + matches_.size() * replacement.size();
+        return output_size_;
+    }
+
+    std::size_t output_size() const noexcept { return output_size_; }
+    std::size_t num_matches() const noexcept { return matches_.size(); }
+
+    /**
+     * Writes the output of the last `prepare` call to `out`, which must have
+     * room for at least `output_size()` bytes.
+     */
+    void write(char* out) const noexcept
+    {
+        const char* const begin = out;
+        std::size_t pos = 0;
+        for(const auto& match : matches_) {
+            out = copy(out, input_.substr(pos, match.begin - pos));
+            out = copy(out, replacement_);
+            pos = match.end;
+        }
+        out = copy(out, input_.substr(pos));
+        assert(std::size_t(out - begin) == output_size_);
+        (void)begin;
+    }
+
+    /**
+     * Replaces matches into a caller-supplied buffer. Returns the size of the
+     * output, and if it exceeds `capacity`, nothing is written, but a retry
+     * with a large enough buffer may call `write` without rescanning.
+     */
+    std::size_t replace_all(const regex::pattern& pattern, std::string_view input,
+        std::string_view replacement, char* out, const std::size_t capacity)
+    {
+        const auto size = prepare(pattern, input, replacement);
+        if(size <= capacity) {
+            write(out);
+        }
+        return size;
+    }
+
+    /** Returns a copy of `input` in which all matches are replaced. */
+    std::string replace_all(const regex::pattern& pattern, std::string_view input,
+        std::string_view replacement)
+    {
+        std::string output(prepare(pattern, input, replacement), '\0');
+        write(output.data());
+        return output;
+    }
+
+private:
+    static char* copy(char* out, std::string_view s) noexcept
+    {
+        if(!s.empty()) {
+            std::memcpy(out, s.data(), s.size());
+        }
+        return out + s.size();
+    }
+};
+
+/**
+ * Returns a copy of `input` in which all matches of `pattern` are replaced
+ * with `replacement`, using a thread-local `replacer`.
+ */
+inline std::string replace_all(const regex::pattern& pattern, std::string_view input,
+    std::string_view replacement)
+{
+    thread_local replacer r;
+    return r.replace_all(pattern, input, replacement);
+}
+
+} // replace
+
+#endif
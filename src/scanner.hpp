@@ -0,0 +1,459 @@
+#ifndef SCANNER_HEADER
+#define SCANNER_HEADER
+
+#include <string_view>
+#include <algorithm>
+#include <stdexcept>
+#include <system_error>
+#include <memory>
+#include <vector>
+#include <optional>
+#include <type_traits>
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#ifdef __linux__
+# include <linux/io_uring.h>
+# include <sys/syscall.h>
+#endif
+
+#include "fsm.hpp"
+#include "utf8.hpp"
+
+namespace scanner {
+
+enum class backend
+{
+    /** Maps the whole file into memory and scans it in one go. */
+    mmap,
+    /**
+     * Keeps a queue of reads into fixed, registered buffers in flight and
+     * scans each buffer as soon as it and all its predecessors have been
+     * read, so that disk I/O overlaps matching. Linux only; if the kernel
+     * doesn't support io_uring, or the buffers can't be registered (e.g.
+     * as they'd exceed the locked memory limit), the mmap backend is used
+     * instead.
+     */
+    io_uring,
+};
+
+struct options
+{
+    enum backend backend = backend::mmap;
+    /** The number of reads the io_uring backend keeps in flight. */
+    int queue_depth = 8;
+    /** The size of each of the io_uring backend's registered buffers. */
+    std::size_t buffer_size = 64 * 1024;
+};
+
+namespace detail {
+
+[[noreturn]] inline void throw_errno(const int error, const char* what)
+{
+    throw std::system_error(error, std::system_category(), what);
+}
+
+class file
+{
+    int fd_;
+
+public:
+    explicit file(const char* path) : fd_(::open(path, O_RDONLY | O_CLOEXEC))
+    {
+        if(fd_ == -1) {
+            throw_errno(errno, "open");
+        }
+    }
+
+    file(const file&) = delete;
+    file& operator=(const file&) = delete;
+
+    ~file() { ::close(fd_); }
+
+    int fd() const noexcept { return fd_; }
+
+    std::uint64_t size() const
+    {
+        struct stat st;
+        if(::fstat(fd_, &st) == -1) {
+            throw_errno(errno, "fstat");
+        }
+        return st.st_size;
+    }
+};
+
+/** Passes `chunk` to `on_chunk` and returns whether reading should go on. */
+template<typename OnChunk>
+bool invoke_on_chunk(OnChunk& on_chunk, std::string_view chunk)
+{
+    if constexpr(std::is_void_v<std::invoke_result_t<OnChunk&, std::string_view>>) {
+        on_chunk(chunk);
+        return true;
+    } else {
+        return on_chunk(chunk);
+    }
+}
+
+template<typename OnChunk>
+void read_file_mmap(const file& file, OnChunk& on_chunk)
+{
+    const auto size = file.size();
+    if(size == 0) { return; }
+    void* data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file.fd(), 0);
+    if(data == MAP_FAILED) {
+        throw_errno(errno, "mmap");
+    }
+    ::madvise(data, size, MADV_SEQUENTIAL);
+    struct unmapper {
+        void* data; std::size_t size;
+        ~unmapper() { ::munmap(data, size); }
+    } unmapper{data, size};
+    invoke_on_chunk(on_chunk, std::string_view(static_cast<const char*>(data), size));
+}
+
+#ifdef __linux__
+
+/**
+ * A minimal io_uring instance driven directly through the io_uring_setup,
+ * io_uring_enter and io_uring_register system calls.
+ */
+class ring
+{
+    int fd_ = -1;
+    io_uring_params params_{};
+
+    void* sq_ring_ = MAP_FAILED;
+    std::size_t sq_ring_size_ = 0;
+    void* cq_ring_ = MAP_FAILED;
+    std::size_t cq_ring_size_ = 0;
+    io_uring_sqe* sqes_ = static_cast<io_uring_sqe*>(MAP_FAILED);
+
+    unsigned* sq_head_;
+    unsigned* sq_tail_;
+    unsigned* sq_mask_;
+    unsigned* sq_array_;
+    unsigned* cq_head_;
+    unsigned* cq_tail_;
+    unsigned* cq_mask_;
+    io_uring_cqe* cqes_;
+
+    // The number of submission queue entries prepared since the last call
+    // to `submit_and_wait`.
+    unsigned to_submit_ = 0;
+
+public:
+    /**
+     * Sets up a ring with at least `entries` submission queue entries. If the
+     * kernel doesn't support io_uring, `is_supported` returns false, any other
+     * failure results in an exception.
+     */
+    explicit ring(const unsigned entries)
+    {
+        fd_ = ::syscall(__NR_io_uring_setup, entries, &params_);
+        if(fd_ == -1) {
+            if(errno == ENOSYS || errno == EPERM) { return; }
+            throw_errno(errno, "io_uring_setup");
+        }
+
+        sq_ring_size_ = params_.sq_off.array + params_.sq_entries * sizeof(unsigned);
+        cq_ring_size_ = params_.cq_off.cqes + params_.cq_entries * sizeof(io_uring_cqe);
+        const bool is_single_mmap = params_.features & IORING_FEAT_SINGLE_MMAP;
+        if(is_single_mmap) {
+            sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+        }
+
+        sq_ring_ = map(sq_ring_size_, IORING_OFF_SQ_RING);
+        cq_ring_ = is_single_mmap ? sq_ring_ : map(cq_ring_size_, IORING_OFF_CQ_RING);
+        sqes_ = static_cast<io_uring_sqe*>(map(
+            params_.sq_entries * sizeof(io_uring_sqe), IORING_OFF_SQES));
+
+        auto* sq = static_cast<char*>(sq_ring_);
+        sq_head_ = reinterpret_cast<unsigned*>(sq + params_.sq_off.head);
+        sq_tail_ = reinterpret_cast<unsigned*>(sq + params_.sq_off.tail);
+        sq_mask_ = reinterpret_cast<unsigned*>(sq + params_.sq_off.ring_mask);
+        sq_array_ = reinterpret_cast<unsigned*>(sq + params_.sq_off.array);
+        auto* cq = static_cast<char*>(cq_ring_);
+        cq_head_ = reinterpret_cast<unsigned*>(cq + params_.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned*>(cq + params_.cq_off.tail);
+        cq_mask_ = reinterpret_cast<unsigned*>(cq + params_.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params_.cq_off.cqes);
+    }
+
+    ring(const ring&) = delete;
+    ring& operator=(const ring&) = delete;
+
+    ~ring()
+    {
+        if(sqes_ != MAP_FAILED) {
+            ::munmap(sqes_, params_.sq_entries * sizeof(io_uring_sqe));
+        }
+        if(cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) {
+            ::munmap(cq_ring_, cq_ring_size_);
+        }
+        if(sq_ring_ != MAP_FAILED) {
+            ::munmap(sq_ring_, sq_ring_size_);
+        }
+        if(fd_ != -1) {
+            ::close(fd_);
+        }
+    }
+
+    bool is_supported() const noexcept { return fd_ != -1; }
+
+    /**
+     * Returns false if the buffers can't be registered, e.g. because before
+     * Linux 5.12 they count against RLIMIT_MEMLOCK, which is often as low as
+     * 64 KiB. Any other failure results in an exception.
+     */
+    bool register_buffers(const iovec* buffers, const unsigned n)
+    {
+        if(::syscall(__NR_io_uring_register, fd_, IORING_REGISTER_BUFFERS, buffers, n) == -1) {
+            if(errno == ENOMEM || errno == EPERM || errno == EINVAL) { return false; }
+            throw_errno(errno, "io_uring_register");
+        }
+        return true;
+    }
+
+    /**
+     * Queues a read of `len` bytes at `offset` of `fd` into `buffer`, which
+     * must lie within the registered buffer at index `buffer_index`. The
+     * request is only handed to the kernel by `submit_and_wait`.
+     */
+    void prepare_read_fixed(const int fd, char* buffer, const unsigned len,
+        const std::uint64_t offset, const int buffer_index, const std::uint64_t user_data)
+    {
+        const unsigned tail = *sq_tail_;
+        const unsigned index = tail & *sq_mask_;
+        assert(tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) < params_.sq_entries);
+        io_uring_sqe& sqe = sqes_[index];
+        sqe = io_uring_sqe{};
+        sqe.opcode = IORING_OP_READ_FIXED;
+        sqe.fd = fd;
+        sqe.addr = reinterpret_cast<std::uint64_t>(buffer);
+        sqe.len = len;
+        sqe.off = offset;
+        sqe.buf_index = buffer_index;
+        sqe.user_data = user_data;
+        sq_array_[index] = index;
+        // Publish the entry to the kernel.
+        __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+        ++to_submit_;
+    }
+
+    /**
+     * Submits all prepared requests and blocks until at least `min_complete`
+     * completions are available.
+     */
+    void submit_and_wait(const unsigned min_complete)
+    {
+        while(true) {
+            const auto submitted = ::syscall(__NR_io_uring_enter, fd_, to_submit_,
+                min_complete, IORING_ENTER_GETEVENTS, nullptr, 0);
+            if(submitted >= 0) {
+                to_submit_ -= submitted;
+                return;
+            }
+            if(errno != EINTR) {
+                throw_errno(errno, "io_uring_enter");
+            }
+        }
+    }
+
+    /** Invokes `f(user_data, res)` for each available completion. */
+    template<typename F>
+    void reap_completions(F&& f)
+    {
+        unsigned head = *cq_head_;
+        const unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        for(; head != tail; ++head) {
+            const io_uring_cqe& cqe = cqes_[head & *cq_mask_];
+            f(cqe.user_data, cqe.res);
+        }
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    }
+
+private:
+    void* map(const std::size_t size, const std::uint64_t offset)
+    {
+        void* p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, fd_, offset);
+        if(p == MAP_FAILED) {
+            throw_errno(errno, "mmap");
+        }
+        return p;
+    }
+};
+
+/** Returns false if the kernel doesn't support io_uring or its registered buffers. */
+template<typename OnChunk>
+bool read_file_io_uring(const file& file, const options& opts, OnChunk& on_chunk)
+{
+    if(opts.queue_depth < 1 || opts.buffer_size < 1) {
+        throw std::invalid_argument("queue depth and buffer size must be larger than zero");
+    }
+
+    const unsigned depth = opts.queue_depth;
+    // The buffers are declared before the ring so that they outlive it: if
+    // scanning throws while reads are in flight, the ring is torn down
+    // before the memory the kernel may still write to is freed.
+    std::unique_ptr<char[]> storage;
+    std::vector<iovec> buffers;
+    ring ring(depth);
+    if(!ring.is_supported()) { return false; }
+
+    const auto size = file.size();
+    if(size == 0) { return true; }
+
+    storage.reset(new char[depth * opts.buffer_size]);
+    buffers.resize(depth);
+    for(auto i = 0u; i < depth; ++i) {
+        buffers[i].iov_base = storage.get() + i * opts.buffer_size;
+        buffers[i].iov_len = opts.buffer_size;
+    }
+    if(!ring.register_buffers(buffers.data(), depth)) { return false; }
+
+    // Buffers are assigned consecutive file ranges in round-robin order, so
+    // the buffer at index `head` always holds the earliest unscanned range.
+    struct slot
+    {
+        std::uint64_t offset;
+        std::size_t len;
+        std::size_t filled;
+        bool is_done;
+    };
+    std::vector<slot> slots(depth);
+    std::uint64_t next_offset = 0;
+    unsigned num_in_flight = 0;
+
+    const auto read_rest = [&](const unsigned i) {
+        auto& s = slots[i];
+        ring.prepare_read_fixed(file.fd(), storage.get() + i * opts.buffer_size + s.filled,
+            s.len - s.filled, s.offset + s.filled, i, i);
+        ++num_in_flight;
+    };
+    const auto start_read = [&](const unsigned i) {
+        const auto len = std::min<std::uint64_t>(opts.buffer_size, size - next_offset);
+        slots[i] = slot{next_offset, len, 0, false};
+        next_offset += len;
+        read_rest(i);
+    };
+
+    for(auto i = 0u; i < depth && next_offset < size; ++i) {
+        start_read(i);
+    }
+
+    // Once `on_chunk` stops the read, no more reads are started, but those
+    // in flight are still waited for, as the kernel writes to their buffers.
+    bool is_stopped = false;
+    unsigned head = 0;
+    while(num_in_flight > 0) {
+        ring.submit_and_wait(1);
+        ring.reap_completions([&](const std::uint64_t i, const int res) {
+            --num_in_flight;
+            if(res < 0) {
+                throw_errno(-res, "read");
+            }
+            auto& s = slots[i];
+            s.filled += res;
+            // A read of zero bytes means the file has been truncated since
+            // its size was queried, so don't try to read the rest.
+            if(s.filled < s.len && res > 0 && !is_stopped) {
+                read_rest(i);
+            } else {
+                s.is_done = true;
+            }
+        });
+
+        while(!is_stopped && slots[head].is_done) {
+            auto& s = slots[head];
+            if(s.filled > 0 && !invoke_on_chunk(on_chunk,
+                   std::string_view(storage.get() + head * opts.buffer_size, s.filled))) {
+                is_stopped = true;
+                break;
+            }
+            s.is_done = false;
+            if(next_offset < size) {
+                start_read(head);
+            }
+            head = (head + 1) % depth;
+        }
+    }
+    return true;
+}
+
+#endif // __linux__
+
+} // detail
+
+/**
+ * Invokes `on_chunk` with consecutive chunks of the file at `path` in file
+ * order, each as a `std::string_view` that is only valid for the duration
+ * of the call. If `on_chunk` returns a value, reading stops as soon as it
+ * returns false.
+ */
+template<typename OnChunk>
+void read_file(const char* path, const options& opts, OnChunk&& on_chunk)
+{
+    const detail::file file(path);
+    switch(opts.backend) {
+    case backend::io_uring:
+#ifdef __linux__
+        if(detail::read_file_io_uring(file, opts, on_chunk)) { return; }
+#endif
+        [[fallthrough]];
+    case backend::mmap:
+        detail::read_file_mmap(file, on_chunk);
+        return;
+    }
+}
+
+/**
+ * Simulates `dfa` over the contents of the file at `path` using the chosen
+ * I/O backend. Reading stops as soon as the DFA reaches a terminal state.
+ */
+inline fsm::result scan_file(const fsm::frozen_dfa& dfa, const char* path,
+    const options& opts = {})
+{
+    fsm::stream_matcher matcher(dfa);
+    read_file(path, opts, [&matcher](std::string_view chunk) {
+        matcher.feed(chunk);
+        return !matcher.is_decided();
+    });
+    return matcher.status();
+}
+
+struct utf8_scan_result
+{
+    /** Reject if the file is not valid UTF-8. */
+    fsm::result result;
+    /** The offset of the file's first invalid UTF-8 sequence, if any. */
+    std::optional<std::size_t> invalid_offset;
+};
+
+/**
+ * Like `scan_file` but also validates that the file is UTF-8, as part of the
+ * same pass over each chunk (see `utf8::validating_matcher`). Nothing after
+ * the first invalid sequence is read, nor after the DFA can no longer match.
+ */
+inline utf8_scan_result scan_file_utf8(const fsm::frozen_dfa& dfa, const char* path,
+    const options& opts = {})
+{
+    utf8::validating_matcher matcher(dfa);
+    read_file(path, opts, [&matcher](std::string_view chunk) {
+        matcher.feed(chunk);
+        return !matcher.is_decided();
+    });
+    const auto result = matcher.finish();
+    return {result, matcher.error_offset()};
+}
+
+} // scanner
+
+#endif
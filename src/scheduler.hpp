@@ -0,0 +1,194 @@
+#ifndef SCHEDULER_HEADER
+#define SCHEDULER_HEADER
+
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <stdexcept>
+#include <algorithm>
+#include <utility>
+#include <cstdint>
+
+#include "fsm.hpp"
+
+namespace scheduler {
+
+using stream_id = std::uint32_t;
+
+/**
+ * Interleaves the matching of many streams on a single thread, e.g. that of
+ * an event loop. Data submitted to a stream is scanned in round-robin order
+ * in fixed quanta of bytes, so a single large payload can't starve the other
+ * streams, and each stream resumes from its saved DFA state.
+ *
+ * Submitted data is not copied: it must stay valid until `run` reports it as
+ * scanned.
+ */
+class scheduler
+{
+    struct chunk
+    {
+        std::string_view data;
+        std::size_t num_scanned;
+    };
+
+    struct stream
+    {
+        fsm::stream_state state;
+        std::deque<chunk> pending;
+        // Tells a stream apart from a later one that reuses its id.
+        std::uint32_t generation = 0;
+        bool is_open = false;
+        bool is_ready = false;
+    };
+
+    const fsm::frozen_dfa* dfa_;
+    std::size_t quantum_;
+    std::vector<stream> streams_;
+    std::vector<stream_id> free_ids_;
+    // The streams with pending data in the order they are to be served, by
+    // id and generation. Closed streams are left in it and skipped once
+    // they come up, so that closing a stream takes constant time.
+    std::deque<std::pair<stream_id, std::uint32_t>> ready_;
+    // The number of entries in `ready_` of streams that are still open.
+    std::size_t num_ready_ = 0;
+
+public:
+    explicit scheduler(const fsm::frozen_dfa& dfa, const std::size_t quantum = 4096)
+        : dfa_(&dfa)
+        , quantum_(quantum)
+    {
+        if(quantum_ < 1) {
+            throw std::invalid_argument("quantum must be larger than zero");
+        }
+    }
+
+    /** Opens a new stream and returns its id, which may be a reused one. */
+    stream_id open()
+    {
+        stream_id id;
+        if(!free_ids_.empty()) {
+            id = free_ids_.back();
+            free_ids_.pop_back();
+        } else {
+            id = streams_.size();
+            streams_.emplace_back();
+        }
+        auto& s = streams_[id];
+        s.state = fsm::start_stream(*dfa_);
+        ++s.generation;
+        s.is_open = true;
+        return id;
+    }
+
+    /** Discards the stream's pending data, which is not reported by `run`. */
+    void close(const stream_id id)
+    {
+        auto& s = get(id);
+        s.pending.clear();
+        s.is_open = false;
+        if(s.is_ready) {
+            s.is_ready = false;
+            --num_ready_;
+        }
+        free_ids_.push_back(id);
+    }
+
+    /**
+     * Queues `data` to be scanned after all previously submitted data. Empty
+     * data is ignored.
+     */
+    void submit(const stream_id id, std::string_view data)
+    {
+        auto& s = get(id);
+        if(data.empty()) { return; }
+        s.pending.push_back({data, 0});
+        make_ready(id);
+    }
+
+    /** Returns the state of the stream, reflecting the data scanned so far. */
+    fsm::result status(const stream_id id) const
+    {
+        return dfa_->classify(get(id).state.state);
+    }
+
+    bool has_pending() const noexcept { return num_ready_ > 0; }
+
+    /**
+     * Scans up to roughly `budget` bytes of pending data, at most one quantum
+     * per stream in turn. Each time a submitted buffer has been scanned in
+     * full, `on_scanned(stream_id, std::string_view data, fsm::result)` is
+     * invoked with it and the stream's resulting state. `on_scanned` may
+     * open, close and submit to streams, including the one it's invoked for.
+     * Returns the number of bytes scanned.
+     */
+    template<typename OnScanned>
+    std::size_t run(const std::size_t budget, OnScanned&& on_scanned)
+    {
+        std::size_t num_scanned = 0;
+        while(num_scanned < budget && !ready_.empty()) {
+            const auto id = ready_.front().first;
+            const auto generation = ready_.front().second;
+            ready_.pop_front();
+            if(!streams_[id].is_open || streams_[id].generation != generation) { continue; }
+            streams_[id].is_ready = false;
+            --num_ready_;
+            // Since `on_scanned` may close the stream, or open streams and
+            // thereby move them all, the stream is looked up anew after each
+            // invocation.
+            const auto is_same_stream = [this, id, generation] {
+                return streams_[id].is_open && streams_[id].generation == generation;
+            };
+
+            auto quantum = std::min(quantum_, budget - num_scanned);
+            while(quantum > 0 && is_same_stream() && !streams_[id].pending.empty()) {
+                auto& s = streams_[id];
+                auto& c = s.pending.front();
+                const auto n = std::min(quantum, c.data.size() - c.num_scanned);
+                s.state.state = dfa_->step(s.state.state, c.data.substr(c.num_scanned, n));
+                quantum -= n;
+                num_scanned += n;
+                c.num_scanned += n;
+                if(c.num_scanned == c.data.size()) {
+                    const auto data = c.data;
+                    s.pending.pop_front();
+                    on_scanned(id, data, dfa_->classify(s.state.state));
+                }
+            }
+
+            // Data submitted by `on_scanned` has already queued the stream.
+            if(is_same_stream() && !streams_[id].pending.empty()) {
+                make_ready(id);
+            }
+        }
+        return num_scanned;
+    }
+
+private:
+    void make_ready(const stream_id id)
+    {
+        auto& s = streams_[id];
+        if(!s.is_ready) {
+            s.is_ready = true;
+            ready_.emplace_back(id, s.generation);
+            ++num_ready_;
+        }
+    }
+
+    stream& get(const stream_id id)
+    {
+        return const_cast<stream&>(static_cast<const scheduler*>(this)->get(id));
+    }
+
+    const stream& get(const stream_id id) const
+    {
+        if(id >= streams_.size() || !streams_[id].is_open) {
+            throw std::invalid_argument("invalid stream id");
+        }
+        return streams_[id];
+    }
+};
+
+} // scheduler
+
+#endif
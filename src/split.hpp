@@ -0,0 +1,183 @@
+#ifndef SPLIT_HEADER
+#define SPLIT_HEADER
+
+#include <string_view>
+#include <iterator>
+#include <optional>
+#include <cstddef>
+
+#include "regex.hpp"
+
+namespace split {
+
+/**
+ * Iterates over the fields of an input that are separated by the matches of
+ * a delimiter pattern, as views into the input. Empty delimiter matches are
+ * ignored. Like Python's `re.split`, an input with n delimiters has n + 1
+ * fields, so e.g. a trailing delimiter is followed by an empty field.
+ */
+class field_iterator
+{
+    const regex::pattern* delimiter_ = nullptr;
+    std::string_view input_;
+    std::string_view field_;
+    // Where the field after the current one begins, or past the end of the
+    // input if the current field is the last one.
+    std::size_t next_begin_ = 0;
+    bool is_end_ = true;
+
+public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = std::string_view;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const std::string_view*;
+    using reference = const std::string_view&;
+
+    field_iterator() = default;
+
+    field_iterator(const regex::pattern& delimiter, std::string_view input)
+        : delimiter_(&delimiter)
+        , input_(input)
+        , is_end_(false)
+    {
+        ++*this;
+    }
+
+    reference operator*() const noexcept { return field_; }
+    pointer operator->() const noexcept { return &field_; }
+
+    field_iterator& operator++()
+    {
+        if(next_begin_ > input_.size()) {
+            is_end_ = true;
+            return *this;
+        }
+        const auto begin = next_begin_;
+        auto offset = begin;
+        std::optional<regex::span> delimiter;
+        while((delimiter = delimiter_->find(input_, offset)) && delimiter->size() == 0) {
+            offset = delimiter->begin + 1;
+        }
+        if(delimiter) {
+            field_ = input_.substr(begin, delimiter->begin - begin);
+            next_begin_ = delimiter->end;
+        } else {
+            field_ = input_.substr(begin);
+            next_begin_ = input_.size() + 1;
+        }
+        return *this;
+    }
+
+    field_iterator operator++(int)
+    {
+        auto tmp = *this;
+        ++*this;
+        return tmp;
+    }
+
+    friend bool operator==(const field_iterator& a, const field_iterator& b) noexcept
+    {
+        if(a.is_end_ || b.is_end_) { return a.is_end_ == b.is_end_; }
+        return a.field_.data() == b.field_.data() && a.next_begin_ == b.next_begin_;
+    }
+
+    friend bool operator!=(const field_iterator& a, const field_iterator& b) noexcept
+    {
+        return !(a == b);
+    }
+};
+
+/** Iterates over the matches of a pattern in an input, as views into the input. */
+class token_iterator
+{
+    const regex::pattern* pattern_ = nullptr;
+    std::string_view input_;
+    std::string_view token_;
+    std::size_t next_offset_ = 0;
+    bool is_end_ = true;
+
+public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = std::string_view;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const std::string_view*;
+    using reference = const std::string_view&;
+
+    token_iterator() = default;
+
+    token_iterator(const regex::pattern& pattern, std::string_view input)
+        : pattern_(&pattern)
+        , input_(input)
+        , is_end_(false)
+    {
+        ++*this;
+    }
+
+    reference operator*() const noexcept { return token_; }
+    pointer operator->() const noexcept { return &token_; }
+
+    token_iterator& operator++()
+    {
+        const auto match = pattern_->find(input_, next_offset_);
+        if(!match) {
+            is_end_ = true;
+            return *this;
+        }
+        token_ = input_.substr(match->begin, match->size());
+        next_offset_ = regex::pattern::next_offset(*match);
+        return *this;
+    }
+
+    token_iterator operator++(int)
+    {
+        auto tmp = *this;
+        ++*this;
+        return tmp;
+    }
+
+    friend bool operator==(const token_iterator& a, const token_iterator& b) noexcept
+    {
+        if(a.is_end_ || b.is_end_) { return a.is_end_ == b.is_end_; }
+        return a.token_.data() == b.token_.data() && a.next_offset_ == b.next_offset_;
+    }
+
+    friend bool operator!=(const token_iterator& a, const token_iterator& b) noexcept
+    {
+        return !(a == b);
+    }
+};
+
+template<typename Iterator>
+class range
+{
+    Iterator begin_;
+
+public:
+    explicit range(Iterator begin) : begin_(begin) {}
+    Iterator begin() const { return begin_; }
+    Iterator end() const { return {}; }
+};
+
+/**
+ * Returns the fields of `input` separated by `delimiter`. Fields are found
+ * lazily, as the range is iterated, and nothing is allocated. Both
+ * `delimiter` and `input` must outlive the range.
+ */
+inline range<field_iterator> fields(const regex::pattern& delimiter, std::string_view input)
+{
+    return range<field_iterator>(field_iterator(delimiter, input));
+}
+
+/**
+ * Returns the leftmost-longest, non-overlapping matches of `pattern` in
+ * `input`. Tokens are found lazily, as the range is iterated, and nothing is
+ * allocated. Both `pattern` and `input` must outlive the range.
+ */
+inline range<token_iterator> tokens(const regex::pattern& pattern, std::string_view input)
+{
+    return range<token_iterator>(token_iterator(pattern, input));
+}
+
+} // split
+
+#endif
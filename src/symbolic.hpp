@@ -0,0 +1,453 @@
+#ifndef SYMBOLIC_HEADER
+#define SYMBOLIC_HEADER
+
+#include <vector>
+#include <map>
+#include <set>
+#include <stack>
+#include <tuple>
+#include <limits>
+#include <iterator>
+#include <optional>
+#include <algorithm>
+#include <stdexcept>
+#include <initializer_list>
+#include <cstdint>
+
+#include "fsm.hpp"
+
+/**
+ * Automata over alphabets of integer symbols (e.g. token or event type ids)
+ * that are far too large to enumerate. Transitions are labeled with sets of
+ * symbols, represented as intervals, rather than with single symbols.
+ */
+namespace symbolic {
+
+using symbol_t = std::int32_t;
+using fsm::state_t;
+
+constexpr symbol_t min_symbol = std::numeric_limits<symbol_t>::min();
+constexpr symbol_t max_symbol = std::numeric_limits<symbol_t>::max();
+
+/** An inclusive range of symbols. */
+struct interval
+{
+    symbol_t first;
+    symbol_t last;
+};
+
+/** A set of symbols as sorted, disjoint and non-adjacent intervals. */
+class interval_set
+{
+    std::vector<interval> intervals_;
+
+public:
+    interval_set() = default;
+
+    interval_set(std::initializer_list<interval> intervals)
+    {
+        for(const auto& i : intervals) {
+            add(i);
+        }
+    }
+
+    static interval_set all() { return {{min_symbol, max_symbol}}; }
+
+    const std::vector<interval>& intervals() const noexcept { return intervals_; }
+
+    bool empty() const noexcept { return intervals_.empty(); }
+
+    void add(const interval i)
+    {
+        if(i.first > i.last) {
+            throw std::invalid_argument("invalid interval");
+        }
+        intervals_.push_back(i);
+        std::sort(intervals_.begin(), intervals_.end(), [](const interval& a, const interval& b) {
+            return a.first < b.first;
+        });
+        std::vector<interval> merged;
+        for(const auto& i : intervals_) {
+            if(!merged.empty() && std::int64_t(i.first) <= std::int64_t(merged.back().last) + 1) {
+                merged.back().last = std::max(merged.back().last, i.last);
+            } else {
+                merged.push_back(i);
+            }
+        }
+        intervals_ = std::move(merged);
+    }
+
+    bool contains(const symbol_t s) const noexcept
+    {
+        const auto it = std::upper_bound(intervals_.begin(), intervals_.end(), s,
+            [](const symbol_t s, const interval& i) { return s < i.first; });
+        return it != intervals_.begin() && s <= std::prev(it)->last;
+    }
+
+    interval_set complement() const
+    {
+        interval_set result;
+        std::int64_t next = min_symbol;
+        for(const auto& i : intervals_) {
+            if(i.first > next) {
+                result.intervals_.push_back({symbol_t(next), symbol_t(i.first - 1)});
+            }
+            next = std::int64_t(i.last) + 1;
+        }
+        if(next <= max_symbol) {
+            result.intervals_.push_back({symbol_t(next), max_symbol});
+        }
+        return result;
+    }
+};
+
+/**
+ * An NFA whose transitions are stored as adjacency lists, so that its size
+ * doesn't depend on that of the alphabet. Like `fsm::nfa`, the start state is
+ * the first and the final state is the last one.
+ */
+class nfa
+{
+public:
+    struct transition
+    {
+        interval_set symbols;
+        state_t to;
+    };
+
+private:
+    std::vector<std::vector<transition>> transitions_;
+    std::vector<std::vector<state_t>> epsilon_transitions_;
+
+public:
+    explicit nfa(const int size)
+        : transitions_(size)
+        , epsilon_transitions_(size)
+    {
+        if(size < 1) {
+            throw std::invalid_argument("n must be larger than zero");
+        }
+    }
+
+    int size() const noexcept { return transitions_.size(); }
+
+    state_t start_state() const noexcept { return 0; }
+    state_t final_state() const noexcept { return size() - 1; }
+
+    const std::vector<transition>& transitions(const state_t s) const { return transitions_[s]; }
+    const std::vector<state_t>& epsilon_transitions(const state_t s) const { return epsilon_transitions_[s]; }
+
+    void add_transition(const state_t from, const state_t to, interval_set symbols)
+    {
+        if(!is_legal_state(from) || !is_legal_state(to)) {
+            throw std::invalid_argument("invalid state");
+        }
+        if(!symbols.empty()) {
+            transitions_[from].push_back({std::move(symbols), to});
+        }
+    }
+
+    void add_epsilon_transition(const state_t from, const state_t to)
+    {
+        if(!is_legal_state(from) || !is_legal_state(to)) {
+            throw std::invalid_argument("invalid state");
+        }
+        epsilon_transitions_[from].push_back(to);
+    }
+
+    /** Copies the states of `other` into this NFA, starting at `offset`. */
+    void embed(const nfa& other, const state_t offset)
+    {
+        if(offset < 0 || offset + other.size() > size()) {
+            throw std::invalid_argument("invalid offset");
+        }
+        for(state_t s = 0; s < other.size(); ++s) {
+            for(const auto& t : other.transitions_[s]) {
+                transitions_[offset + s].push_back({t.symbols, offset + t.to});
+            }
+            for(const auto to : other.epsilon_transitions_[s]) {
+                epsilon_transitions_[offset + s].push_back(offset + to);
+            }
+        }
+    }
+
+private:
+    bool is_legal_state(const state_t s) const noexcept
+    {
+        return s >= 0 && s < size();
+    }
+};
+
+// Thompson's construction, as in `thompson`, for symbolic NFAs.
+
+inline nfa build_symbols(interval_set symbols)
+{
+    nfa result(2);
+    result.add_transition(0, 1, std::move(symbols));
+    return result;
+}
+
+inline nfa build_symbol(const symbol_t s)
+{
+    return build_symbols({{s, s}});
+}
+
+inline nfa build_concatenation(const nfa& a, const nfa& b)
+{
+    nfa result(a.size() + b.size());
+    result.embed(a, 0);
+    result.embed(b, a.size());
+    result.add_epsilon_transition(a.final_state(), a.size());
+    return result;
+}
+
+inline nfa build_alternation(const nfa& a, const nfa& b)
+{
+    nfa result(a.size() + b.size() + 2);
+    result.embed(a, 1);
+    result.embed(b, 1 + a.size());
+    result.add_epsilon_transition(0, 1);
+    result.add_epsilon_transition(0, 1 + a.size());
+    result.add_epsilon_transition(a.size(), result.final_state());
+    result.add_epsilon_transition(a.size() + b.size(), result.final_state());
+    return result;
+}
+
+inline nfa build_kleene_star(const nfa& n)
+{
+    nfa result(n.size() + 2);
+    result.embed(n, 1);
+    result.add_epsilon_transition(0, 1);
+    result.add_epsilon_transition(0, result.final_state());
+    result.add_epsilon_transition(n.size(), 1);
+    result.add_epsilon_transition(n.size(), result.final_state());
+    return result;
+}
+
+inline nfa build_question_mark(const nfa& n)
+{
+    auto result = n;
+    result.add_epsilon_transition(result.start_state(), result.final_state());
+    return result;
+}
+
+inline nfa build_plus_sign(const nfa& n)
+{
+    return build_concatenation(n, build_kleene_star(n));
+}
+
+/**
+ * A DFA over integer symbols. Determinization partitions the symbols leaving
+ * each subset of NFA states into the intervals on which the same NFA states
+ * are reached, so its cost depends on the number of interval boundaries
+ * rather than on the size of the alphabet.
+ *
+ * The symbols are then partitioned into classes on which all states behave
+ * the same, and transitions are stored in a dense table indexed by state
+ * and class. A symbol's class is looked up by binary search in the sorted
+ * starts of the intervals of the partition, of which there are usually few,
+ * even if the alphabet is huge. State 0 is the dead state, as in
+ * `fsm::frozen_dfa`.
+ */
+class dfa
+{
+public:
+    static constexpr state_t dead_state = 0;
+
+private:
+    // The first symbol of each interval of the partition, in ascending order,
+    // starting with `min_symbol`, and the class of each interval.
+    std::vector<symbol_t> interval_starts_;
+    std::vector<int> interval_classes_;
+    int num_classes_ = 0;
+    std::vector<state_t> transitions_;
+    std::vector<char> accepting_;
+    state_t start_;
+
+public:
+    explicit dfa(const nfa& nfa)
+    {
+        struct piece
+        {
+            std::int64_t first;
+            std::int64_t last;
+            state_t to;
+        };
+
+        const auto epsilon_closure = [&nfa](std::vector<state_t> states) {
+            std::set<state_t> closure(states.begin(), states.end());
+            while(!states.empty()) {
+                const auto s = states.back();
+                states.pop_back();
+                for(const auto to : nfa.epsilon_transitions(s)) {
+                    if(closure.insert(to).second) {
+                        states.push_back(to);
+                    }
+                }
+            }
+            return std::vector<state_t>(closure.begin(), closure.end());
+        };
+
+        // Subset construction, where each DFA state's transitions are kept as
+        // sorted, disjoint pieces of symbols that lead to a non-dead state.
+        std::map<std::vector<state_t>, state_t> ids;
+        std::stack<std::vector<state_t>> to_process;
+        std::vector<std::vector<piece>> pieces;
+        const auto get_state = [&](std::vector<state_t> states) {
+            const auto [it, inserted] = ids.try_emplace(states, ids.size());
+            if(inserted) {
+                pieces.emplace_back();
+                accepting_.push_back(std::binary_search(
+                    states.begin(), states.end(), nfa.final_state()));
+                to_process.push(std::move(states));
+            }
+            return it->second;
+        };
+        get_state({});
+        start_ = get_state(epsilon_closure({nfa.start_state()}));
+
+        while(!to_process.empty()) {
+            const auto states = std::move(to_process.top());
+            to_process.pop();
+            const auto from = ids[states];
+
+            // Sweep over the boundaries of the outgoing intervals, keeping
+            // track of how many of them reach each NFA state.
+            std::vector<std::tuple<std::int64_t, int, state_t>> events;
+            for(const auto s : states) {
+                for(const auto& t : nfa.transitions(s)) {
+                    for(const auto& i : t.symbols.intervals()) {
+                        events.emplace_back(i.first, 1, t.to);
+                        events.emplace_back(std::int64_t(i.last) + 1, -1, t.to);
+                    }
+                }
+            }
+            std::sort(events.begin(), events.end());
+            std::map<state_t, int> active;
+            std::vector<piece> result;
+            for(std::size_t i = 0; i < events.size();) {
+                const auto point = std::get<0>(events[i]);
+                for(; i < events.size() && std::get<0>(events[i]) == point; ++i) {
+                    const auto [_, delta, to] = events[i];
+                    if((active[to] += delta) == 0) {
+                        active.erase(to);
+                    }
+                }
+                if(active.empty() || i == events.size()) { continue; }
+                std::vector<state_t> reachable;
+                for(const auto& [to, _] : active) {
+                    reachable.push_back(to);
+                }
+                const auto to = get_state(epsilon_closure(std::move(reachable)));
+                const auto last = std::get<0>(events[i]) - 1;
+                if(!result.empty() && result.back().to == to && result.back().last + 1 == point) {
+                    result.back().last = last;
+                } else {
+                    result.push_back({point, last, to});
+                }
+            }
+            pieces[from] = std::move(result);
+        }
+
+        // Partition the symbols at every boundary of some state's pieces and
+        // give intervals on which all states transition alike the same class.
+        std::vector<std::int64_t> boundaries{min_symbol};
+        for(const auto& state_pieces : pieces) {
+            for(const auto& p : state_pieces) {
+                boundaries.push_back(p.first);
+                boundaries.push_back(p.last + 1);
+            }
+        }
+        std::sort(boundaries.begin(), boundaries.end());
+        boundaries.erase(std::unique(boundaries.begin(), boundaries.end()), boundaries.end());
+        if(boundaries.back() > max_symbol) {
+            boundaries.pop_back();
+        }
+
+        std::map<std::vector<state_t>, int> class_ids;
+        std::vector<std::size_t> next_piece(size(), 0);
+        for(const auto b : boundaries) {
+            std::vector<state_t> column(size(), dead_state);
+            for(state_t s = 0; s < size(); ++s) {
+                auto& p = next_piece[s];
+                while(p < pieces[s].size() && pieces[s][p].last < b) { ++p; }
+                if(p < pieces[s].size() && pieces[s][p].first <= b) {
+                    column[s] = pieces[s][p].to;
+                }
+            }
+            const auto [it, inserted] = class_ids.try_emplace(std::move(column), class_ids.size());
+            if(interval_classes_.empty() || interval_classes_.back() != it->second) {
+                interval_starts_.push_back(b);
+                interval_classes_.push_back(it->second);
+            }
+        }
+
+        num_classes_ = class_ids.size();
+        transitions_.resize(size() * num_classes_);
+        for(const auto& [column, c] : class_ids) {
+            for(state_t s = 0; s < size(); ++s) {
+                transitions_[s * num_classes_ + c] = column[s];
+            }
+        }
+    }
+
+    int size() const noexcept { return accepting_.size(); }
+
+    /** The number of classes of symbols that all states treat alike. */
+    int num_classes() const noexcept { return num_classes_; }
+
+    state_t start_state() const noexcept { return start_; }
+
+    bool is_accepting(const state_t s) const noexcept { return accepting_[s]; }
+
+    int symbol_class(const symbol_t symbol) const noexcept
+    {
+        const auto it = std::upper_bound(interval_starts_.begin(), interval_starts_.end(), symbol);
+        return interval_classes_[it - interval_starts_.begin() - 1];
+    }
+
+    state_t next(const state_t s, const symbol_t symbol) const noexcept
+    {
+        return transitions_[s * num_classes_ + symbol_class(symbol)];
+    }
+
+    /** Returns whether the DFA matches the whole sequence of symbols. */
+    fsm::result simulate(const symbol_t* symbols, const std::size_t size) const noexcept
+    {
+        auto s = start_;
+        for(std::size_t i = 0; i < size && s != dead_state; ++i) {
+            s = next(s, symbols[i]);
+        }
+        return is_accepting(s) ? fsm::result::accept : fsm::result::reject;
+    }
+
+    /** Overload for contiguous ranges of symbols, e.g. `std::vector<symbol_t>`. */
+    template<typename Symbols>
+    fsm::result simulate(const Symbols& symbols) const noexcept
+    {
+        return simulate(std::data(symbols), std::size(symbols));
+    }
+
+    /** Returns the length of the longest prefix of the symbols that is matched. */
+    std::optional<std::size_t> longest_prefix(const symbol_t* symbols, const std::size_t size) const noexcept
+    {
+        std::optional<std::size_t> longest;
+        auto s = start_;
+        if(is_accepting(s)) { longest = 0; }
+        for(std::size_t i = 0; i < size && s != dead_state; ++i) {
+            s = next(s, symbols[i]);
+            if(is_accepting(s)) { longest = i + 1; }
+        }
+        return longest;
+    }
+
+    template<typename Symbols>
+    std::optional<std::size_t> longest_prefix(const Symbols& symbols) const noexcept
+    {
+        return longest_prefix(std::data(symbols), std::size(symbols));
+    }
+};
+
+} // symbolic
+
+#endif
@@ -0,0 +1,286 @@
+#ifndef TRANSDUCER_HEADER
+#define TRANSDUCER_HEADER
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <stack>
+#include <utility>
+#include <tuple>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <cstdint>
+
+#include "fsm.hpp"
+
+namespace transducer {
+
+/** The output of a transition. */
+struct action
+{
+    enum kind_type : std::uint8_t
+    {
+        /** Outputs the input byte itself. */
+        copy,
+        /** Outputs a fixed string, possibly empty. */
+        emit,
+    };
+
+    kind_type kind;
+    std::string output;
+
+    static action copy_input() { return {copy, {}}; }
+    static action drop() { return {emit, {}}; }
+    static action emit_byte(const char c) { return {emit, std::string(1, c)}; }
+    static action emit_string(std::string_view s) { return {emit, std::string(s)}; }
+};
+
+/**
+ * A deterministic Mealy machine over bytes: each transition, in addition to
+ * moving to the next state, outputs the input byte, a string, or nothing.
+ * A whole chain of transformations (e.g. escaping followed by normalization)
+ * can be composed into a single transducer that is applied in one streaming
+ * pass over the input. Each state may also have a final output, which is
+ * emitted when the input ends in that state (e.g. to flush a pending escape
+ * character).
+ *
+ * A newly constructed transducer has a single state, the start state, in
+ * which every byte is copied to the output.
+ */
+class transducer
+{
+public:
+    static constexpr fsm::state_t start_state = 0;
+    static constexpr int alphabet_size = fsm::frozen_dfa::alphabet_size;
+
+private:
+    struct transition
+    {
+        fsm::state_t to;
+        bool copies_input;
+        // The output as a range in `outputs_` if the input is not copied.
+        std::uint32_t output_offset;
+        std::uint32_t output_size;
+    };
+
+    std::vector<transition> transitions_;
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> final_outputs_;
+    std::string outputs_;
+    // The offsets of the distinct outputs in `outputs_` by the hash of the
+    // output. Offsets rather than views are stored as the pool may move.
+    std::unordered_multimap<std::size_t, std::uint32_t> output_offsets_;
+
+public:
+    transducer() { add_state(); }
+
+    int size() const noexcept { return final_outputs_.size(); }
+
+    /**
+     * Returns a transducer with the states and transitions of `dfa`, whose
+     * transition from `from` on `c` to `to` outputs `make_action(from, c, to)`
+     * (in terms of the states of `dfa`). State `s` of `dfa` is state `s` of
+     * the transducer, except that the start state of `dfa` and state 0 swap
+     * places, see `state_of`.
+     */
+    template<typename MakeAction>
+    static transducer from_dfa(const fsm::frozen_dfa& dfa, MakeAction&& make_action)
+    {
+        transducer result;
+        for(auto s = 1; s < dfa.size(); ++s) {
+            result.add_state();
+        }
+        for(auto s = 0; s < dfa.size(); ++s) {
+            for(auto c = 0; c < alphabet_size; ++c) {
+                const auto to = dfa.next(s, c);
+                result.set_transition(state_of(dfa, s), c, state_of(dfa, to),
+                    std::invoke(make_action, fsm::state_t(s), static_cast<unsigned char>(c), to));
+            }
+        }
+        return result;
+    }
+
+    /** Returns the state of a transducer built by `from_dfa(dfa, ...)` for state `s` of `dfa`. */
+    static fsm::state_t state_of(const fsm::frozen_dfa& dfa, const fsm::state_t s) noexcept
+    {
+        if(s == dfa.start_state()) { return start_state; }
+        if(s == start_state) { return dfa.start_state(); }
+        return s;
+    }
+
+    /** Adds a state in which every byte is copied and leads to the state itself. */
+    fsm::state_t add_state()
+    {
+        const fsm::state_t s = size();
+        final_outputs_.emplace_back(0, 0);
+        for(auto c = 0; c < alphabet_size; ++c) {
+            transitions_.push_back({s, true, 0, 0});
+        }
+        return s;
+    }
+
+    void set_transition(const fsm::state_t from, const unsigned char input,
+        const fsm::state_t to, const action& action)
+    {
+        if(!is_legal_state(from) || !is_legal_state(to)) {
+            throw std::invalid_argument("invalid state");
+        }
+        auto& t = transitions_[from * alphabet_size + input];
+        t.to = to;
+        t.copies_input = action.kind == action::copy;
+        if(!t.copies_input) {
+            std::tie(t.output_offset, t.output_size) = add_output(action.output);
+        }
+    }
+
+    /** Sets the transitions on all inputs of `from`. */
+    void set_transitions(const fsm::state_t from, const fsm::state_t to, const action& action)
+    {
+        for(auto c = 0; c < alphabet_size; ++c) {
+            set_transition(from, c, to, action);
+        }
+    }
+
+    void set_final_output(const fsm::state_t s, std::string_view output)
+    {
+        if(!is_legal_state(s)) {
+            throw std::invalid_argument("invalid state");
+        }
+        final_outputs_[s] = add_output(output);
+    }
+
+    /**
+     * Consumes `input` from state `s`, passing the output to `sink` in pieces
+     * of `std::string_view`s, and returns the state reached. Consecutive bytes
+     * that are copied are passed as a single piece.
+     */
+    template<typename Sink>
+    fsm::state_t feed(fsm::state_t s, std::string_view input, Sink&& sink) const
+    {
+        std::size_t copy_begin = 0;
+        for(std::size_t i = 0; i < input.size(); ++i) {
+            const auto& t = transitions_[s * alphabet_size + static_cast<unsigned char>(input[i])];
+            if(!t.copies_input) {
+                if(copy_begin < i) {
+                    sink(input.substr(copy_begin, i - copy_begin));
+                }
+                copy_begin = i + 1;
+                if(t.output_size > 0) {
+                    sink(std::string_view(outputs_).substr(t.output_offset, t.output_size));
+                }
+            }
+            s = t.to;
+        }
+        if(copy_begin < input.size()) {
+            sink(input.substr(copy_begin));
+        }
+        return s;
+    }
+
+    /** Passes the final output of `s`, if any, to `sink`. */
+    template<typename Sink>
+    void finish(const fsm::state_t s, Sink&& sink) const
+    {
+        const auto [offset, size] = final_outputs_[s];
+        if(size > 0) {
+            sink(std::string_view(outputs_).substr(offset, size));
+        }
+    }
+
+    /** Transforms the complete `input`. */
+    std::string apply(std::string_view input) const
+    {
+        std::string output;
+        const auto append = [&output](std::string_view s) { output += s; };
+        finish(feed(start_state, input, append), append);
+        return output;
+    }
+
+    /**
+     * Returns a transducer that is equivalent to applying `first` and then
+     * applying `second` to its output, via product construction.
+     */
+    static transducer compose(const transducer& first, const transducer& second)
+    {
+        transducer result;
+        std::map<std::pair<fsm::state_t, fsm::state_t>, fsm::state_t> ids;
+        std::stack<std::pair<fsm::state_t, fsm::state_t>> to_process;
+        const auto get_state = [&](const std::pair<fsm::state_t, fsm::state_t> states) {
+            const auto [it, inserted] = ids.try_emplace(states, ids.size());
+            if(inserted) {
+                if(it->second != start_state) { result.add_state(); }
+                to_process.push(states);
+            }
+            return it->second;
+        };
+        // Runs `second` from `s` over `input` and returns its state and output.
+        const auto run_second = [&second](const fsm::state_t s, std::string_view input) {
+            std::string output;
+            const auto to = second.feed(s, input,
+                [&output](std::string_view piece) { output += piece; });
+            return std::make_pair(to, std::move(output));
+        };
+
+        get_state({start_state, start_state});
+        while(!to_process.empty()) {
+            const auto [s1, s2] = to_process.top();
+            to_process.pop();
+            const auto from = ids[{s1, s2}];
+
+            for(auto c = 0; c < alphabet_size; ++c) {
+                const auto& t = first.transitions_[s1 * alphabet_size + c];
+                const char byte = c;
+                const auto first_output = t.copies_input
+                    ? std::string_view(&byte, 1)
+                    : std::string_view(first.outputs_).substr(t.output_offset, t.output_size);
+                const auto [to2, output] = run_second(s2, first_output);
+                const auto to = get_state({t.to, to2});
+                if(output.size() == 1 && output[0] == byte) {
+                    result.set_transition(from, c, to, action::copy_input());
+                } else {
+                    result.set_transition(from, c, to, action::emit_string(output));
+                }
+            }
+
+            const auto [offset, size] = first.final_outputs_[s1];
+            auto final = run_second(s2, std::string_view(first.outputs_).substr(offset, size));
+            auto& final_output = final.second;
+            second.finish(final.first, [&final_output](std::string_view s) { final_output += s; });
+            result.set_final_output(from, final_output);
+        }
+        return result;
+    }
+
+private:
+    bool is_legal_state(const fsm::state_t s) const noexcept
+    {
+        return s >= 0 && s < size();
+    }
+
+    std::pair<std::uint32_t, std::uint32_t> add_output(std::string_view output)
+    {
+        if(output.empty()) { return {0, 0}; }
+        // Reuse an identical output if there is one, which keeps the pool
+        // small when many transitions emit the same string.
+        const auto h = std::hash<std::string_view>()(output);
+        const auto [first, last] = output_offsets_.equal_range(h);
+        for(auto it = first; it != last; ++it) {
+            if(std::string_view(outputs_).substr(it->second, output.size()) == output) {
+                return {it->second, std::uint32_t(output.size())};
+            }
+        }
+        if(output.size() > std::numeric_limits<std::uint32_t>::max() - outputs_.size()) {
+            throw std::length_error("transducer outputs exceed 4 GiB");
+        }
+        const auto offset = std::uint32_t(outputs_.size());
+        outputs_ += output;
+        output_offsets_.emplace(h, offset);
+        return {offset, std::uint32_t(output.size())};
+    }
+};
+
+} // transducer
+
+#endif
@@ -0,0 +1,306 @@
+#ifndef TRIGRAM_HEADER
+#define TRIGRAM_HEADER
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <deque>
+#include <optional>
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+#include <cstdint>
+
+#include "fsm.hpp"
+#include "regex.hpp"
+
+/**
+ * An inverted index from trigrams (three consecutive bytes) to the documents
+ * containing them, with which a regex search over a corpus only runs the
+ * DFA on the documents that contain the trigrams every match must contain.
+ */
+namespace trigram {
+
+using trigram_t = std::uint32_t;
+using doc_id = std::uint32_t;
+
+inline trigram_t make_trigram(const unsigned char a, const unsigned char b, const unsigned char c) noexcept
+{
+    return (trigram_t(a) << 16) | (trigram_t(b) << 8) | c;
+}
+
+/** Invokes `on_trigram(trigram_t)` for each trigram of `s`, in order. */
+template<typename OnTrigram>
+void for_each_trigram(std::string_view s, OnTrigram&& on_trigram)
+{
+    for(std::size_t i = 0; i + 3 <= s.size(); ++i) {
+        on_trigram(make_trigram(s[i], s[i + 1], s[i + 2]));
+    }
+}
+
+/**
+ * A query in disjunctive normal form: a document is a candidate if it
+ * contains all trigrams of any of the conjunctions. An empty conjunction
+ * matches all documents, and an empty query none.
+ */
+struct query
+{
+    std::vector<std::vector<trigram_t>> any_of;
+
+    bool matches_all() const noexcept
+    {
+        return std::any_of(any_of.begin(), any_of.end(),
+            [](const auto& all_of) { return all_of.empty(); });
+    }
+};
+
+namespace detail {
+
+/**
+ * Returns a shortest input that leads from `s` to an accepting state, or
+ * nothing if `s` isn't live.
+ */
+inline std::optional<std::string> shortest_accepted(const fsm::frozen_dfa& dfa, const fsm::state_t s)
+{
+    if(!dfa.is_live(s)) { return std::nullopt; }
+    std::vector<std::pair<fsm::state_t, unsigned char>> parents(dfa.size(), {-1, 0});
+    std::deque<fsm::state_t> to_visit{s};
+    parents[s] = {s, 0};
+    while(!to_visit.empty()) {
+        auto t = to_visit.front();
+        to_visit.pop_front();
+        if(dfa.is_accepting(t)) {
+            std::string input;
+            for(; t != s; t = parents[t].first) {
+                input += parents[t].second;
+            }
+            std::reverse(input.begin(), input.end());
+            return input;
+        }
+        for(auto c = 0; c < fsm::frozen_dfa::alphabet_size; ++c) {
+            const auto u = dfa.next(t, c);
+            if(parents[u].first == -1 && dfa.is_live(u)) {
+                parents[u] = {t, static_cast<unsigned char>(c)};
+                to_visit.push_back(u);
+            }
+        }
+    }
+    return std::nullopt;
+}
+
+/**
+ * Returns whether every input that is `prefix` followed by an input leading
+ * from `s` to an accepting state contains trigram `t`. This is decided by
+ * searching the product of the DFA and an automaton that tracks how much of
+ * `t` the input ends in for an accepting state in which `t` hasn't occurred.
+ */
+inline bool is_required(const fsm::frozen_dfa& dfa, std::string_view prefix, const fsm::state_t s,
+    const trigram_t t)
+{
+    const unsigned char pattern[] = {
+        static_cast<unsigned char>(t >> 16), static_cast<unsigned char>(t >> 8), static_cast<unsigned char>(t)};
+    // The length of the longest suffix that is a prefix of `t`, after
+    // matching `k` of its bytes and then consuming `c`.
+    const auto advance = [&pattern](int k, const unsigned char c) {
+        while(true) {
+            if(pattern[k] == c) { return k + 1; }
+            if(k == 0) { return 0; }
+            // Fall back to the longest proper border of the matched part.
+            k = (k == 2 && pattern[1] == pattern[0]) ? 1 : 0;
+        }
+    };
+
+    int k = 0;
+    for(const unsigned char c : prefix) {
+        k = advance(k, c);
+        if(k == 3) { return true; }
+    }
+
+    std::vector<char> is_visited(dfa.size() * 3, false);
+    std::vector<std::pair<fsm::state_t, int>> to_visit{{s, k}};
+    is_visited[s * 3 + k] = true;
+    while(!to_visit.empty()) {
+        const auto [u, j] = to_visit.back();
+        to_visit.pop_back();
+        if(dfa.is_accepting(u)) { return false; }
+        for(auto c = 0; c < fsm::frozen_dfa::alphabet_size; ++c) {
+            const auto v = dfa.next(u, c);
+            const auto l = advance(j, c);
+            if(l < 3 && dfa.is_live(v) && !is_visited[v * 3 + l]) {
+                is_visited[v * 3 + l] = true;
+                to_visit.emplace_back(v, l);
+            }
+        }
+    }
+    return true;
+}
+
+} // detail
+
+/**
+ * Derives the query for the documents that contain a match of `dfa`, which
+ * must be in full match mode. The trigrams every match must contain are
+ * those of a shortest match that can't be avoided by any other match. To
+ * also capture alternatives (e.g. `abc|xyz`), the matches are first split
+ * by their first few bytes into up to `max_conjunctions` groups, each of
+ * which yields a conjunction of its own.
+ */
+inline query derive_query(const fsm::frozen_dfa& dfa, const std::size_t max_conjunctions = 16)
+{
+    if(dfa.mode() != fsm::match_mode::full) {
+        throw std::invalid_argument("queries can only be derived from full match mode DFAs");
+    }
+    struct group
+    {
+        std::string prefix;
+        fsm::state_t state;
+    };
+
+    std::vector<group> groups;
+    if(dfa.is_live(dfa.start_state())) {
+        groups.push_back({"", dfa.start_state()});
+    }
+    for(auto depth = 0; depth < 3; ++depth) {
+        std::vector<group> split;
+        for(const auto& g : groups) {
+            // An accepting group can't be split, as its prefix is a match
+            // of its own.
+            if(dfa.is_accepting(g.state)) {
+                split.push_back(g);
+                continue;
+            }
+            for(auto c = 0; c < fsm::frozen_dfa::alphabet_size; ++c) {
+                const auto t = dfa.next(g.state, c);
+                if(dfa.is_live(t)) {
+                    split.push_back({g.prefix + char(c), t});
+                }
+            }
+        }
+        if(split.size() > max_conjunctions) { break; }
+        groups = std::move(split);
+    }
+
+    query q;
+    for(const auto& g : groups) {
+        const auto match = g.prefix + *detail::shortest_accepted(dfa, g.state);
+        std::vector<trigram_t> all_of;
+        for_each_trigram(match, [&](const trigram_t t) {
+            if(detail::is_required(dfa, g.prefix, g.state, t)) {
+                all_of.push_back(t);
+            }
+        });
+        std::sort(all_of.begin(), all_of.end());
+        all_of.erase(std::unique(all_of.begin(), all_of.end()), all_of.end());
+        if(all_of.empty()) {
+            // Matches all documents, so the other conjunctions are moot.
+            q.any_of.assign(1, {});
+            break;
+        }
+        q.any_of.push_back(std::move(all_of));
+    }
+    std::sort(q.any_of.begin(), q.any_of.end());
+    q.any_of.erase(std::unique(q.any_of.begin(), q.any_of.end()), q.any_of.end());
+    return q;
+}
+
+inline query derive_query(std::string_view regex)
+{
+    return derive_query(regex::compile(regex));
+}
+
+/**
+ * An in-memory inverted index. Any other index with the same
+ * `num_documents()` and `postings(trigram_t)` members, the latter returning
+ * a range of document ids in ascending order, e.g. one backed by files, can
+ * be used with `candidates` and `search` in its stead.
+ */
+class memory_index
+{
+    std::unordered_map<trigram_t, std::vector<doc_id>> postings_;
+    std::vector<doc_id> empty_;
+    doc_id num_documents_ = 0;
+
+public:
+    /** Indexes the next document, whose id is the number of documents before it. */
+    doc_id add(std::string_view document)
+    {
+        const auto id = num_documents_++;
+        for_each_trigram(document, [this, id](const trigram_t t) {
+            auto& docs = postings_[t];
+            if(docs.empty() || docs.back() != id) {
+                docs.push_back(id);
+            }
+        });
+        return id;
+    }
+
+    doc_id num_documents() const noexcept { return num_documents_; }
+
+    const std::vector<doc_id>& postings(const trigram_t t) const
+    {
+        const auto it = postings_.find(t);
+        return it == postings_.end() ? empty_ : it->second;
+    }
+};
+
+/** Returns the ids of the documents in `index` that satisfy `q`, in ascending order. */
+template<typename Index>
+std::vector<doc_id> candidates(const Index& index, const query& q)
+{
+    std::vector<doc_id> result;
+    if(q.matches_all()) {
+        result.resize(index.num_documents());
+        for(doc_id id = 0; id < result.size(); ++id) {
+            result[id] = id;
+        }
+        return result;
+    }
+
+    for(const auto& all_of : q.any_of) {
+        // Intersect the shortest posting lists first.
+        std::vector<const std::vector<doc_id>*> lists;
+        for(const auto t : all_of) {
+            lists.push_back(&index.postings(t));
+        }
+        std::sort(lists.begin(), lists.end(), [](const auto* a, const auto* b) {
+            return a->size() < b->size();
+        });
+        std::vector<doc_id> docs(lists.front()->begin(), lists.front()->end());
+        for(std::size_t i = 1; i < lists.size() && !docs.empty(); ++i) {
+            std::vector<doc_id> intersection;
+            std::set_intersection(docs.begin(), docs.end(), lists[i]->begin(), lists[i]->end(),
+                std::back_inserter(intersection));
+            docs = std::move(intersection);
+        }
+        std::vector<doc_id> merged;
+        std::set_union(result.begin(), result.end(), docs.begin(), docs.end(),
+            std::back_inserter(merged));
+        result = std::move(merged);
+    }
+    return result;
+}
+
+/**
+ * Returns the ids of the documents that contain a match of `regex`, in
+ * ascending order. Only the candidates the index returns are fetched with
+ * `get_document(doc_id)`, which returns the document as something
+ * convertible to `std::string_view`, and matched.
+ */
+template<typename Index, typename GetDocument>
+std::vector<doc_id> search(const Index& index, std::string_view regex, GetDocument&& get_document)
+{
+    const auto dfa = regex::compile(regex);
+    const auto search_dfa = fsm::frozen_dfa::combine({dfa}, fsm::match_mode::search);
+    std::vector<doc_id> result;
+    for(const auto id : candidates(index, derive_query(dfa))) {
+        if(search_dfa.simulate(std::string_view(get_document(id))) == fsm::result::accept) {
+            result.push_back(id);
+        }
+    }
+    return result;
+}
+
+} // trigram
+
+#endif
@@ -0,0 +1,665 @@
+#ifndef UTF8_HEADER
+#define UTF8_HEADER
+
+#include <string_view>
+#include <vector>
+#include <map>
+#include <tuple>
+#include <algorithm>
+#include <optional>
+#include <stdexcept>
+
+#if defined(__SSSE3__)
+# include <tmmintrin.h>
+#elif defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+
+#include "fsm.hpp"
+
+namespace utf8 {
+
+constexpr char32_t max_code_point = 0x10ffff;
+constexpr char32_t surrogates_first = 0xd800;
+constexpr char32_t surrogates_last = 0xdfff;
+
+/** An inclusive range of code points. */
+struct range
+{
+    char32_t first;
+    char32_t last;
+};
+
+/** An inclusive range of bytes. */
+struct byte_range
+{
+    unsigned char first;
+    unsigned char last;
+};
+
+/**
+ * Decodes the code point at `pos` in `s` and advances `pos` past it. Throws
+ * if `s` is not valid UTF-8 there.
+ */
+inline char32_t decode(std::string_view s, std::size_t& pos)
+{
+    const auto byte = [&s](const std::size_t i) { return static_cast<unsigned char>(s[i]); };
+    const auto lead = byte(pos);
+    int size;
+    char32_t cp;
+    if(lead < 0x80) {
+        ++pos;
+        return lead;
+    } else if(lead >= 0xc2 && lead <= 0xdf) {
+        size = 2;
+        cp = lead & 0x1f;
+    } else if(lead >= 0xe0 && lead <= 0xef) {
+        size = 3;
+        cp = lead & 0x0f;
+    } else if(lead >= 0xf0 && lead <= 0xf4) {
+        size = 4;
+        cp = lead & 0x07;
+    } else {
+        throw std::invalid_argument("invalid UTF-8");
+    }
+    if(pos + size > s.size()) {
+        throw std::invalid_argument("invalid UTF-8");
+    }
+    for(auto i = 1; i < size; ++i) {
+        const auto b = byte(pos + i);
+        if((b & 0xc0) != 0x80) {
+            throw std::invalid_argument("invalid UTF-8");
+        }
+        cp = (cp << 6) | (b & 0x3f);
+    }
+    constexpr char32_t min_code_points[] = {0, 0, 0x80, 0x800, 0x10000};
+    if(cp < min_code_points[size] || cp > max_code_point
+       || (cp >= surrogates_first && cp <= surrogates_last)) {
+        throw std::invalid_argument("invalid UTF-8");
+    }
+    pos += size;
+    return cp;
+}
+
+/** Encodes `cp` into `out` and returns the number of bytes written. */
+inline int encode(const char32_t cp, unsigned char* out) noexcept
+{
+    if(cp < 0x80) {
+        out[0] = cp;
+        return 1;
+    } else if(cp < 0x800) {
+        out[0] = 0xc0 | (cp >> 6);
+        out[1] = 0x80 | (cp & 0x3f);
+        return 2;
+    } else if(cp < 0x10000) {
+        out[0] = 0xe0 | (cp >> 12);
+        out[1] = 0x80 | ((cp >> 6) & 0x3f);
+        out[2] = 0x80 | (cp & 0x3f);
+        return 3;
+    }
+    out[0] = 0xf0 | (cp >> 18);
+    out[1] = 0x80 | ((cp >> 12) & 0x3f);
+    out[2] = 0x80 | ((cp >> 6) & 0x3f);
+    out[3] = 0x80 | (cp & 0x3f);
+    return 4;
+}
+
+/**
+ * Sorts and merges `ranges`, removes the surrogates (which have no valid
+ * encoding), and if `negate` is set, returns their complement instead.
+ */
+inline std::vector<range> normalize(std::vector<range> ranges, const bool negate = false)
+{
+    std::sort(ranges.begin(), ranges.end(), [](const range& a, const range& b) {
+        return a.first < b.first;
+    });
+    std::vector<range> merged;
+    for(const auto& r : ranges) {
+        if(r.first > r.last) {
+            throw std::invalid_argument("invalid code point range");
+        }
+        if(!merged.empty() && r.first <= merged.back().last + 1) {
+            merged.back().last = std::max(merged.back().last, r.last);
+        } else {
+            merged.push_back(r);
+        }
+    }
+
+    if(negate) {
+        std::vector<range> complement;
+        char32_t next = 0;
+        for(const auto& r : merged) {
+            if(r.first > next) {
+                complement.push_back({next, r.first - 1});
+            }
+            next = r.last + 1;
+        }
+        if(next <= max_code_point) {
+            complement.push_back({next, max_code_point});
+        }
+        merged = std::move(complement);
+    }
+
+    std::vector<range> result;
+    for(const auto& r : merged) {
+        if(r.first < surrogates_first && r.last > surrogates_last) {
+            result.push_back({r.first, surrogates_first - 1});
+            result.push_back({surrogates_last + 1, r.last});
+        } else if(r.first >= surrogates_first && r.last <= surrogates_last) {
+            continue;
+        } else if(r.first >= surrogates_first && r.first <= surrogates_last) {
+            result.push_back({surrogates_last + 1, r.last});
+        } else if(r.last >= surrogates_first && r.last <= surrogates_last) {
+            result.push_back({r.first, surrogates_first - 1});
+        } else {
+            result.push_back(r);
+        }
+    }
+    return result;
+}
+
+/**
+ * Splits the code point range `r`, which must not contain surrogates, into
+ * sequences of byte ranges such that the encodings of the code points in `r`
+ * are exactly the byte strings matched by one of the sequences, and invokes
+ * `on_sequence(const byte_range*, int size)` with each.
+ */
+template<typename OnSequence>
+void for_each_byte_sequence(const range r, OnSequence&& on_sequence)
+{
+    constexpr char32_t max_code_points[] = {0x7f, 0x7ff, 0xffff, max_code_point};
+    std::vector<range> to_process{r};
+    while(!to_process.empty()) {
+        auto [first, last] = to_process.back();
+        to_process.pop_back();
+
+        // Each sequence must have a single encoded length.
+        bool is_split = false;
+        for(const auto max : max_code_points) {
+            if(first <= max && max < last) {
+                to_process.push_back({max + 1, last});
+                to_process.push_back({first, max});
+                is_split = true;
+                break;
+            }
+        }
+        if(is_split) { continue; }
+
+        // In a sequence, all but the last byte of `first` and `last` may only
+        // differ in one position if the bytes that follow span their whole
+        // range of continuation bytes, so split off the parts that don't.
+        for(auto i = 1; i < 4; ++i) {
+            const char32_t mask = (char32_t(1) << (6 * i)) - 1;
+            if((first & ~mask) != (last & ~mask)) {
+                if((first & mask) != 0) {
+                    to_process.push_back({(first | mask) + 1, last});
+                    to_process.push_back({first, first | mask});
+                    is_split = true;
+                    break;
+                }
+                if((last & mask) != mask) {
+                    to_process.push_back({last & ~mask, last});
+                    to_process.push_back({first, (last & ~mask) - 1});
+                    is_split = true;
+                    break;
+                }
+            }
+        }
+        if(is_split) { continue; }
+
+        unsigned char first_bytes[4];
+        unsigned char last_bytes[4];
+        const auto size = encode(first, first_bytes);
+        encode(last, last_bytes);
+        byte_range sequence[4];
+        for(auto i = 0; i < size; ++i) {
+            sequence[i] = {first_bytes[i], last_bytes[i]};
+        }
+        on_sequence(sequence, size);
+    }
+}
+
+/**
+ * Builds an NFA that matches the UTF-8 encoding of a single code point in
+ * `ranges`, which must be normalized. The byte sequences of all ranges are
+ * merged from their ends, so that e.g. all the trailing continuation bytes
+ * share the same states, which keeps the NFA (and the resulting DFA) small.
+ *
+ * NUL can't be matched, since an NFA can't represent a transition on it, so
+ * `ranges` must not contain it.
+ */
+inline fsm::nfa build_class(const std::vector<range>& ranges)
+{
+    if(!ranges.empty() && ranges.front().first == 0) {
+        throw std::invalid_argument("NUL can't be matched");
+    }
+    // Byte automaton whose states are numbered from 0 (the start state) and
+    // whose final state is `accept`.
+    constexpr int start = 0;
+    constexpr int accept = 1;
+    struct edge { int from; byte_range bytes; int to; };
+    std::vector<edge> edges;
+    int num_states = 2;
+    // A state that matches a byte range and then transitions to a state is
+    // shared by all sequences with that same suffix.
+    std::map<std::tuple<unsigned char, unsigned char, int>, int> suffix_states;
+
+    for(const auto& r : ranges) {
+        for_each_byte_sequence(r, [&](const byte_range* sequence, const int size) {
+            auto to = accept;
+            for(auto i = size - 1; i > 0; --i) {
+                const auto key = std::make_tuple(sequence[i].first, sequence[i].last, to);
+                auto it = suffix_states.find(key);
+                if(it == suffix_states.end()) {
+                    it = suffix_states.emplace(key, num_states++).first;
+                    edges.push_back({it->second, sequence[i], to});
+                }
+                to = it->second;
+            }
+            edges.push_back({start, sequence[0], to});
+        });
+    }
+
+    // An NFA may only have one transition between two states, so a byte
+    // range can't be a single transition. Instead, a byte goes from a state
+    // for its high nibble, entered from the source via an epsilon transition,
+    // to a state for its low nibble, which leads to the target via an
+    // epsilon transition. These states are shared by all ranges with the
+    // same source and target, respectively, so a class needs at most 32 of
+    // them per state of the byte automaton, rather than one per byte. The
+    // nibble states only have epsilon transitions and are thus ignored by
+    // subset construction, so all bytes of a range still yield a single DFA
+    // state.
+    struct transition { int from; int to; fsm::input_t input; };
+    std::vector<transition> transitions;
+    std::map<std::pair<int, int>, std::vector<int>> bytes;
+    for(const auto& e : edges) {
+        auto& b = bytes[{e.from, e.to}];
+        for(int c = e.bytes.first; c <= e.bytes.last; ++c) {
+            b.push_back(c);
+        }
+    }
+    std::map<std::pair<int, int>, int> high_states;
+    std::map<std::pair<int, int>, int> low_states;
+    const auto get_state = [&](std::map<std::pair<int, int>, int>& states, const int s,
+            const int nibble, const bool is_entered) {
+        const auto [it, inserted] = states.try_emplace({s, nibble}, num_states);
+        if(inserted) {
+            ++num_states;
+            if(is_entered) {
+                transitions.push_back({s, it->second, fsm::epsilon});
+            } else {
+                transitions.push_back({it->second, s, fsm::epsilon});
+            }
+        }
+        return it->second;
+    };
+    for(const auto& [states, b] : bytes) {
+        const auto [from, to] = states;
+        if(b.size() == 1) {
+            transitions.push_back({from, to, b.front()});
+            continue;
+        }
+        for(const auto c : b) {
+            transitions.push_back({get_state(high_states, from, c >> 4, true),
+                get_state(low_states, to, c & 0xf, false), c});
+        }
+    }
+
+    // The NFA's final state must be its last one.
+    fsm::nfa nfa(num_states);
+    const auto map_state = [&](const int s) {
+        if(s == accept) { return nfa.final_state(); }
+        return s > accept ? s - 1 : s;
+    };
+    for(const auto& t : transitions) {
+        nfa.add_transition(map_state(t.from), map_state(t.to), t.input);
+    }
+    return nfa;
+}
+
+/** Builds an NFA that matches the UTF-8 encoding of `cp`, which must not be NUL. */
+inline fsm::nfa build_code_point(const char32_t cp)
+{
+    if(cp == 0) {
+        throw std::invalid_argument("NUL can't be matched");
+    }
+    unsigned char bytes[4];
+    const auto size = encode(cp, bytes);
+    fsm::nfa nfa(size + 1);
+    for(auto i = 0; i < size; ++i) {
+        nfa.add_transition(i, i + 1, bytes[i]);
+    }
+    return nfa;
+}
+
+/** Builds an NFA that matches any code point except NUL and a line feed. */
+inline fsm::nfa build_any()
+{
+    return build_class(normalize({{0, 0}, {'\n', '\n'}}, true));
+}
+
+/**
+ * Validates UTF-8 input that arrives in chunks, which may split sequences.
+ *
+ * With SSSE3, input is validated 16 bytes at a time by looking up the
+ * possible errors of each pair of adjacent bytes by their nibbles (after
+ * Keiser and Lemire, "Validating UTF-8 In Less Than One Instruction Per
+ * Byte"), and only a block in which an error is detected is rescanned
+ * byte by byte to find it. With only SSE2, blocks of ASCII are skipped.
+ */
+class validator
+{
+    // The number of bytes fed before the current chunk.
+    std::size_t offset_ = 0;
+    // The offset of the first byte of the sequence being validated.
+    std::size_t sequence_begin_ = 0;
+    // The number of bytes the current sequence still needs and the range
+    // the next of them must be in.
+    int num_pending_ = 0;
+    unsigned char next_min_ = 0;
+    unsigned char next_max_ = 0;
+    std::optional<std::size_t> error_offset_;
+
+public:
+    /**
+     * Validates the next chunk of input and returns whether the input is
+     * valid so far, though it may still end in an incomplete sequence. Once
+     * it is invalid, further input is ignored.
+     */
+    bool feed(std::string_view chunk) noexcept
+    {
+        if(error_offset_) { return false; }
+        const auto* data = reinterpret_cast<const unsigned char*>(chunk.data());
+        const auto size = chunk.size();
+        for(std::size_t i = 0; i < size;) {
+            if(num_pending_ == 0) {
+                i = validate_blocks(data, i, size);
+            }
+            // Validate at least a block's worth of bytes one by one before
+            // trying whole blocks again, which would likely fail again.
+            for(const auto end = std::min(size, i + 16); i < end; ++i) {
+                if(!step(data[i], offset_ + i)) { return false; }
+            }
+        }
+        offset_ += size;
+        return true;
+    }
+
+    /** Signals the end of the input and returns whether it was valid. */
+    bool finish() noexcept
+    {
+        if(!error_offset_ && num_pending_ > 0) {
+            error_offset_ = sequence_begin_;
+        }
+        return !error_offset_;
+    }
+
+    bool is_valid() const noexcept { return !error_offset_; }
+
+    /**
+     * Returns the offset of the first byte of the first invalid (e.g.
+     * truncated, overlong or surrogate) sequence in the input, if any.
+     */
+    std::optional<std::size_t> error_offset() const noexcept { return error_offset_; }
+
+    void reset() noexcept { *this = validator(); }
+
+private:
+    bool step(const unsigned char byte, const std::size_t offset) noexcept
+    {
+        if(num_pending_ > 0) {
+            if(byte < next_min_ || byte > next_max_) {
+                error_offset_ = sequence_begin_;
+                return false;
+            }
+            --num_pending_;
+            next_min_ = 0x80;
+            next_max_ = 0xbf;
+            return true;
+        }
+
+        sequence_begin_ = offset;
+        next_min_ = 0x80;
+        next_max_ = 0xbf;
+        if(byte < 0x80) {
+            return true;
+        } else if(byte >= 0xc2 && byte <= 0xdf) {
+            num_pending_ = 1;
+        } else if(byte >= 0xe0 && byte <= 0xef) {
+            num_pending_ = 2;
+            // Exclude overlong encodings and surrogates.
+            if(byte == 0xe0) { next_min_ = 0xa0; }
+            if(byte == 0xed) { next_max_ = 0x9f; }
+        } else if(byte >= 0xf0 && byte <= 0xf4) {
+            num_pending_ = 3;
+            // Exclude overlong encodings and code points above U+10FFFF.
+            if(byte == 0xf0) { next_min_ = 0x90; }
+            if(byte == 0xf4) { next_max_ = 0x8f; }
+        } else {
+            error_offset_ = offset;
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * Validates whole blocks of 16 bytes from `begin`, which must be at the
+     * start of a sequence, and returns the offset from which validation must
+     * continue byte by byte: the start of the sequence that is cut off by
+     * the last block or that contains an error.
+     */
+    static std::size_t validate_blocks(const unsigned char* data, const std::size_t begin,
+        const std::size_t size) noexcept
+    {
+        std::size_t i = begin;
+#if defined(__SSSE3__)
+        const auto zero = _mm_setzero_si128();
+        // Any byte in the last three that is larger than these begins
+        // a sequence that continues in the next block.
+        const auto incomplete_max = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1,
+            -1, -1, -1, -1, -1, char(0xf0 - 1), char(0xe0 - 1), char(0xc0 - 1));
+        auto prev = zero;
+        auto prev_incomplete = zero;
+        for(; size - i >= 16; i += 16) {
+            const auto input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            __m128i error;
+            if(_mm_movemask_epi8(input) == 0) {
+                error = prev_incomplete;
+                prev_incomplete = zero;
+            } else {
+                error = block_errors(input, prev);
+                prev_incomplete = _mm_subs_epu8(input, incomplete_max);
+            }
+            if(_mm_movemask_epi8(_mm_cmpeq_epi8(error, zero)) != 0xffff) { break; }
+            prev = input;
+        }
+#elif defined(__SSE2__)
+        for(; size - i >= 16; i += 16) {
+            const auto input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            if(_mm_movemask_epi8(input) != 0) { break; }
+        }
+#endif
+        // Back up to the start of the sequence that `i` may be in the middle
+        // of, which is at most three bytes back.
+        for(std::size_t back = 1; back <= 3 && back <= i - begin; ++back) {
+            const auto byte = data[i - back];
+            if((byte & 0xc0) != 0x80) {
+                return byte >= 0xc0 ? i - back : i;
+            }
+        }
+        return i;
+    }
+
+#if defined(__SSSE3__)
+    /**
+     * Returns a non-zero vector if the 16 bytes of `input`, preceded by those
+     * of `prev`, contain an invalid sequence. Each pair of adjacent bytes is
+     * classified by looking up the errors possible for the high and low
+     * nibble of the first and the high nibble of the second byte, the
+     * intersection of which are the errors present. Continuation bytes that
+     * are expected after three and four byte leads cancel out the error of
+     * two consecutive continuation bytes.
+     */
+    static __m128i block_errors(const __m128i input, const __m128i prev) noexcept
+    {
+        constexpr char too_short = 1 << 0;
+        constexpr char too_long = 1 << 1;
+        constexpr char overlong_3 = 1 << 2;
+        constexpr char too_large = 1 << 3;
+        constexpr char surrogate = 1 << 4;
+        constexpr char overlong_2 = 1 << 5;
+        constexpr char too_large_1000 = 1 << 6;
+        constexpr char overlong_4 = 1 << 6;
+        constexpr char two_conts = char(1 << 7);
+        constexpr char carry = too_short | too_long | two_conts;
+
+        const auto byte_1_high_table = _mm_setr_epi8(
+            // 0_______ ________
+            too_long, too_long, too_long, too_long,
+            too_long, too_long, too_long, too_long,
+            // 10______ ________
+            two_conts, two_conts, two_conts, two_conts,
+            // 1100____ ________
+            too_short | overlong_2,
+            // 1101____ ________
+            too_short,
+            // 1110____ ________
+            too_short | overlong_3 | surrogate,
+            // 1111____ ________
+            too_short | too_large | too_large_1000 | overlong_4);
+        const auto byte_1_low_table = _mm_setr_epi8(
+            // ____0000 ________
+            carry | overlong_3 | overlong_2 | overlong_4,
+            // ____0001 ________
+            carry | overlong_2,
+            // ____001_ ________
+            carry, carry,
+            // ____0100 ________
+            carry | too_large,
+            // ____0101 ________ to ____1100 ________
+            carry | too_large | too_large_1000, carry | too_large | too_large_1000,
+            carry | too_large | too_large_1000, carry | too_large | too_large_1000,
+            carry | too_large | too_large_1000, carry | too_large | too_large_1000,
+            carry | too_large | too_large_1000, carry | too_large | too_large_1000,
+            // ____1101 ________
+            carry | too_large | too_large_1000 | surrogate,
+            // ____111_ ________
+            carry | too_large | too_large_1000, carry | too_large | too_large_1000);
+        const auto byte_2_high_table = _mm_setr_epi8(
+            // ________ 0_______
+            too_short, too_short, too_short, too_short,
+            too_short, too_short, too_short, too_short,
+            // ________ 1000____
+            too_long | overlong_2 | two_conts | overlong_3 | too_large_1000 | overlong_4,
+            // ________ 1001____
+            too_long | overlong_2 | two_conts | overlong_3 | too_large,
+            // ________ 101_____
+            too_long | overlong_2 | two_conts | surrogate | too_large,
+            too_long | overlong_2 | two_conts | surrogate | too_large,
+            // ________ 11______
+            too_short, too_short, too_short, too_short);
+
+        const auto nibble_mask = _mm_set1_epi8(0x0f);
+        const auto high_nibbles = [&nibble_mask](const __m128i v) {
+            return _mm_and_si128(_mm_srli_epi16(v, 4), nibble_mask);
+        };
+        const auto prev1 = _mm_alignr_epi8(input, prev, 15);
+        const auto special_cases = _mm_and_si128(
+            _mm_and_si128(_mm_shuffle_epi8(byte_1_high_table, high_nibbles(prev1)),
+                _mm_shuffle_epi8(byte_1_low_table, _mm_and_si128(prev1, nibble_mask))),
+            _mm_shuffle_epi8(byte_2_high_table, high_nibbles(input)));
+
+        const auto prev2 = _mm_alignr_epi8(input, prev, 14);
+        const auto prev3 = _mm_alignr_epi8(input, prev, 13);
+        const auto is_third_byte = _mm_subs_epu8(prev2, _mm_set1_epi8(char(0xe0 - 0x80)));
+        const auto is_fourth_byte = _mm_subs_epu8(prev3, _mm_set1_epi8(char(0xf0 - 0x80)));
+        const auto must_be_continuation = _mm_and_si128(
+            _mm_or_si128(is_third_byte, is_fourth_byte), _mm_set1_epi8(char(0x80)));
+        return _mm_xor_si128(must_be_continuation, special_cases);
+    }
+#endif
+};
+
+/** Returns the offset of the first invalid sequence in `s`, if any. */
+inline std::optional<std::size_t> find_invalid(std::string_view s) noexcept
+{
+    validator v;
+    v.feed(s);
+    v.finish();
+    return v.error_offset();
+}
+
+/**
+ * Simulates a frozen DFA over input that arrives in chunks while validating
+ * that the input is UTF-8. Chunks are processed in blocks that are small
+ * enough to still be cached when they are matched after being validated, so
+ * the input is only read from memory once. Invalid input is rejected.
+ */
+class validating_matcher
+{
+    fsm::stream_matcher matcher_;
+    validator validator_;
+    std::size_t block_size_;
+
+public:
+    static constexpr std::size_t default_block_size = 16 * 1024;
+
+    explicit validating_matcher(const fsm::frozen_dfa& dfa,
+        const std::size_t block_size = default_block_size)
+        : matcher_(dfa)
+        , block_size_(block_size)
+    {
+        if(block_size_ < 1) {
+            throw std::invalid_argument("block size must be larger than zero");
+        }
+    }
+
+    /**
+     * Returns whether the input is valid so far. Once it is invalid, further
+     * input is ignored.
+     */
+    bool feed(std::string_view chunk) noexcept
+    {
+        for(std::size_t i = 0; i < chunk.size(); i += block_size_) {
+            const auto block = chunk.substr(i, block_size_);
+            if(!validator_.feed(block)) { return false; }
+            matcher_.feed(block);
+        }
+        return validator_.is_valid();
+    }
+
+    /**
+     * Signals the end of the input and returns whether it is valid and
+     * matched by the DFA.
+     */
+    fsm::result finish() noexcept
+    {
+        return validator_.finish() ? matcher_.status() : fsm::result::reject;
+    }
+
+    /**
+     * Returns whether no further input can change the result of `finish`:
+     * the input is invalid, or the DFA can no longer match it. That the DFA
+     * accepts regardless of further input doesn't decide it, as that input
+     * must still be valid.
+     */
+    bool is_decided() const noexcept
+    {
+        return !validator_.is_valid()
+            || (matcher_.is_decided() && matcher_.status() == fsm::result::reject);
+    }
+
+    /** See `validator::error_offset`. */
+    std::optional<std::size_t> error_offset() const noexcept { return validator_.error_offset(); }
+
+    void reset() noexcept
+    {
+        matcher_.reset();
+        validator_.reset();
+    }
+};
+
+} // utf8
+
+#endif
@@ -2,10 +2,32 @@
 #include <iomanip>
 #include <cassert>
 #include <algorithm>
+#include <tuple>
+#include <thread>
+#include <atomic>
 
 #include "../src/fsm.hpp"
 #include "../src/thompson.hpp"
 #include "../src/parser.hpp"
+#include "../src/utf8.hpp"
+#include "../src/symbolic.hpp"
+#include "../src/dna.hpp"
+#include "../src/approximate.hpp"
+#include "../src/dictionary.hpp"
+#include "../src/trigram.hpp"
+#include "../src/column.hpp"
+#include "../src/scanner.hpp"
+#include "../src/pipeline.hpp"
+#include "../src/regex.hpp"
+#include "../src/cache.hpp"
+#include "../src/scheduler.hpp"
+#include "../src/split.hpp"
+#include "../src/replace.hpp"
+#include "../src/lexer.hpp"
+#include "../src/transducer.hpp"
+
+#include <cstdio>
+#include <fstream>
 
 std::ostream& operator<<(std::ostream& out, const std::vector<std::vector<fsm::state_t>>& table)
 {
@@ -304,6 +326,1072 @@ void dfa()
     assert(dfa.simulate("aab") == fsm::result::reject);
 }
 
+void frozen_dfa()
+{
+    const auto regex = "(ab|c)*de";
+    const auto nfa = parser::shunting_yard_nfa_parser(regex).parse();
+    const fsm::dfa dfa(nfa, fsm::derive_input_language("abcde"));
+    const fsm::frozen_dfa frozen(dfa);
+    for(const auto input : {"de", "abde", "ccabcde", "", "abd", "abdef", "xde"}) {
+        assert(frozen.simulate(input) == dfa.simulate(input));
+    }
+    assert(frozen.simulate("abcabde") == fsm::result::accept);
+
+    assert(frozen.simulate_prefix("abcabde") == fsm::result::accept);
+    assert(frozen.simulate_prefix("abca") == fsm::result::partial);
+    assert(frozen.simulate_prefix("") == fsm::result::partial);
+    assert(frozen.simulate_prefix("abx") == fsm::result::reject);
+    assert(frozen.simulate_prefix("ba") == fsm::result::reject);
+    assert(frozen.simulate_prefix("dee") == fsm::result::reject);
+    assert(frozen.classify(fsm::frozen_dfa::dead_state) == fsm::result::reject);
+
+    fsm::stream_matcher matcher(frozen);
+    for(const auto chunk : {"a", "bca", "", "bd", "e"}) {
+        matcher.feed(chunk);
+    }
+    assert(matcher.status() == fsm::result::accept);
+    matcher.feed("e");
+    assert(matcher.status() == fsm::result::reject);
+    matcher.reset();
+    matcher.feed("cde");
+    assert(matcher.status() == fsm::result::accept);
+}
+
+void match_modes()
+{
+    const auto nfa = parser::shunting_yard_nfa_parser("(ab|c)*de").parse();
+    const fsm::dfa dfa(nfa, fsm::derive_input_language("abcde"));
+
+    const fsm::frozen_dfa prefix(dfa, fsm::match_mode::prefix);
+    assert(prefix.simulate("abdexyz") == fsm::result::accept);
+    assert(prefix.simulate("xabde") == fsm::result::reject);
+    assert(prefix.simulate("abd") == fsm::result::reject);
+
+    const fsm::frozen_dfa search(dfa, fsm::match_mode::search);
+    assert(search.simulate("xxabcdeyy") == fsm::result::accept);
+    assert(search.simulate("abababd") == fsm::result::reject);
+    assert(search.simulate("ddde") == fsm::result::accept);
+    assert(search.simulate("") == fsm::result::reject);
+
+    // Once a match has been found, the rest of the input is irrelevant.
+    const auto s = search.step(search.start_state(), "xde");
+    assert(search.is_terminal(s) && search.is_accepting(s));
+    assert(search.step(s, "anything") == s);
+
+    // The dead state is terminal in every mode.
+    const fsm::frozen_dfa full(dfa);
+    assert(full.is_terminal(fsm::frozen_dfa::dead_state));
+    assert(full.step(full.start_state(), "x") == fsm::frozen_dfa::dead_state);
+    assert(!full.is_terminal(full.step(full.start_state(), "de")));
+}
+
+void stream_state()
+{
+    const auto nfa = parser::shunting_yard_nfa_parser("(ab|c)*de").parse();
+    const fsm::frozen_dfa dfa(fsm::dfa(nfa, fsm::derive_input_language("abcde")));
+
+    // Interleave the packets of a few flows whose states are kept as bytes.
+    const std::vector<std::vector<std::string>> flows = {
+        {"ab", "c", "d", "e"},
+        {"c", "abd"},
+        {"", "de"},
+    };
+    std::vector<unsigned char> flow_table(flows.size() * fsm::stream_state::serialized_size);
+    for(std::size_t i = 0; i < flows.size(); ++i) {
+        fsm::start_stream(dfa).serialize(&flow_table[i * fsm::stream_state::serialized_size]);
+    }
+    std::vector<fsm::result> results(flows.size());
+    for(std::size_t packet = 0; packet < 4; ++packet) {
+        for(std::size_t i = 0; i < flows.size(); ++i) {
+            if(packet >= flows[i].size()) { continue; }
+            auto* bytes = &flow_table[i * fsm::stream_state::serialized_size];
+            auto state = fsm::stream_state::deserialize(bytes);
+            results[i] = fsm::scan(dfa, state, flows[i][packet]);
+            state.serialize(bytes);
+        }
+    }
+    assert(results[0] == fsm::result::accept);
+    assert(results[1] == fsm::result::reject);
+    assert(results[2] == fsm::result::accept);
+
+    auto state = fsm::start_stream(dfa);
+    assert(fsm::scan_prefix(dfa, state, "abc") == fsm::result::partial);
+    assert(fsm::scan_prefix(dfa, state, "d") == fsm::result::partial);
+    assert(fsm::scan_prefix(dfa, state, "e") == fsm::result::accept);
+    assert(fsm::scan_prefix(dfa, state, "x") == fsm::result::reject);
+    assert(fsm::scan_prefix(dfa, state, "de") == fsm::result::reject);
+}
+
+void scan_file()
+{
+    const auto nfa = parser::shunting_yard_nfa_parser("(ab|c)*de").parse();
+    const fsm::frozen_dfa dfa(fsm::dfa(nfa, fsm::derive_input_language("abcde")));
+
+    const auto path = "degenerexp_scanner_test.txt";
+    const auto scan = [&](const std::string& contents, const scanner::options& opts) {
+        std::ofstream(path, std::ios::binary | std::ios::trunc) << contents;
+        return scanner::scan_file(dfa, path, opts);
+    };
+
+    std::string matching;
+    for(auto i = 0; i < 1000; ++i) {
+        matching += i % 3 ? "ab" : "c";
+    }
+    matching += "de";
+
+    for(const auto backend : {scanner::backend::mmap, scanner::backend::io_uring}) {
+        scanner::options opts;
+        opts.backend = backend;
+        // Use tiny buffers so that many reads are in flight.
+        opts.queue_depth = 4;
+        opts.buffer_size = 7;
+        assert(scan(matching, opts) == fsm::result::accept);
+        assert(scan(matching + 'e', opts) == fsm::result::reject);
+        assert(scan("de", opts) == fsm::result::accept);
+        assert(scan("", opts) == fsm::result::reject);
+        // The DFA is dead after the first byte, so the rest isn't read.
+        assert(scan("x" + matching, opts) == fsm::result::reject);
+
+        // Reading stops as soon as a chunk is refused.
+        std::size_t num_chunks = 0;
+        std::string read;
+        scanner::read_file(path, opts, [&](std::string_view chunk) {
+            read += chunk;
+            return ++num_chunks < 3;
+        });
+        assert(num_chunks == (backend == scanner::backend::mmap ? 1 : 3));
+        assert(read == ("x" + matching).substr(0, read.size()));
+    }
+    std::remove(path);
+}
+
+void run_pipeline()
+{
+    const auto nfa = parser::shunting_yard_nfa_parser("(ab|c)*de").parse();
+    const fsm::frozen_dfa dfa(fsm::dfa(nfa, fsm::derive_input_language("abcde")));
+
+    std::vector<std::string> records;
+    for(auto i = 0; i < 1000; ++i) {
+        records.push_back(std::string(i % 7, 'c') + (i % 2 ? "de" : "dd"));
+    }
+
+    for(const auto num_matchers : {1, 3}) {
+        pipeline::options opts;
+        opts.num_matchers = num_matchers;
+        opts.buffers_per_matcher = 2;
+        opts.buffer_size = 16;
+        std::size_t next = 0;
+        std::vector<int> results(records.size(), -1);
+        pipeline::run(dfa, opts,
+            [&](char* data, std::size_t capacity) -> std::size_t {
+                if(next == records.size()) { return 0; }
+                const auto& record = records[next++];
+                assert(record.size() <= capacity);
+                std::copy(record.begin(), record.end(), data);
+                return record.size();
+            },
+            [&](const pipeline::match_record& record) {
+                assert(results[record.sequence] == -1);
+                results[record.sequence] = record.result == fsm::result::accept;
+            });
+        for(std::size_t i = 0; i < records.size(); ++i) {
+            assert(results[i] == int(i % 2));
+        }
+    }
+
+    pipeline::spsc_ring<int> ring(3);
+    assert(ring.capacity() == 4);
+    for(auto i = 0; i < 4; ++i) {
+        assert(ring.try_push(i));
+    }
+    assert(!ring.try_push(4));
+    int value;
+    assert(ring.try_pop(value) && value == 0);
+    assert(ring.try_push(4));
+    for(auto i = 1; i < 5; ++i) {
+        assert(ring.try_pop(value) && value == i);
+    }
+    assert(!ring.try_pop(value));
+}
+
+void segmented_input()
+{
+    const regex::pattern re("(ab|c)*de");
+
+    assert(re.find("xxabcdeyy") == (regex::span{2, 7}));
+    assert(re.find("xxabcdeyy", 3) == (regex::span{4, 7}));
+    assert(re.find("abcdabde") == (regex::span{4, 8}));
+    assert(re.find("ababd") == std::nullopt);
+    assert(re.find("de", 3) == std::nullopt);
+
+    const std::vector<std::string_view> segments = {"xx", "", "a", "bc", "d", "", "ey"};
+    assert(!re.match(segments));
+    assert(re.find(segments) == (regex::span{2, 7}));
+    assert(re.find(segments, 5) == (regex::span{5, 7}));
+    assert(re.find(segments, 6) == std::nullopt);
+
+    char a[] = "ab";
+    char b[] = "cd";
+    char c[] = "e";
+    const iovec iov[] = {{a, 2}, {b, 2}, {c, 1}};
+    assert(re.match(iov));
+    assert(re.find(iov) == (regex::span{0, 5}));
+
+    // A match that only the leftmost of several candidate starts reaches.
+    const regex::pattern alt("abcd|c");
+    assert(alt.find("xabcd") == (regex::span{1, 5}));
+    assert(alt.find(std::vector<std::string>{"xa", "bc", "d"}) == (regex::span{1, 5}));
+    // A prefix of a match that the input doesn't complete.
+    assert(regex::pattern("abc|b").find("xab") == (regex::span{2, 3}));
+    assert(regex::pattern("abc|b").find(std::vector<std::string>{"x", "", "a", "b"}) == (regex::span{2, 3}));
+
+    // Starts are recovered in a single backwards scan rather than by
+    // rescanning the input from each candidate start, which would take
+    // quadratic time here.
+    const std::string run = std::string(100000, 'a') + "b";
+    assert(regex::pattern("(a)*c|b").find(run) == (regex::span{100000, 100001}));
+
+    // The reversed DFA of x(a|b){18}a(a|b)* would have hundreds of thousands
+    // of states, whereas the forward ones have 22, so it's not built and
+    // starts are found by trying each position instead.
+    std::string wide = "x";
+    for(auto i = 0; i < 18; ++i) {
+        wide += "[ab]";
+    }
+    const regex::pattern wide_pattern(wide + "a([ab])*");
+    assert(wide_pattern.anchored_dfa().size() <= 32);
+    assert(wide_pattern.find("yyx" + std::string(18, 'b') + "abb") == (regex::span{2, 24}));
+    assert(!wide_pattern.find("yyx" + std::string(18, 'b') + "bbb"));
+
+    // Empty matches.
+    const regex::pattern star("a*");
+    assert(star.find("bbb") == (regex::span{0, 0}));
+    assert(star.find("bbaa", 1) == (regex::span{1, 1}));
+    assert(star.find("bbaa", 2) == (regex::span{2, 4}));
+    assert(star.find("bbaa", 4) == (regex::span{4, 4}));
+}
+
+void match_callback()
+{
+    const regex::pattern re({"ab", "abc|d", "b+"});
+    std::vector<std::tuple<int, std::size_t, std::size_t>> matches;
+    re.scan("xabcdabbb", [&](int id, std::size_t begin, std::size_t end) {
+        matches.emplace_back(id, begin, end);
+    });
+    assert((matches == std::vector<std::tuple<int, std::size_t, std::size_t>>{
+        {1, 1, 4}, {1, 4, 5}, {0, 5, 7}, {2, 7, 9}}));
+
+    // Stopping after the second match.
+    matches.clear();
+    re.scan("xabcdabbb", [&](int id, std::size_t begin, std::size_t end) {
+        matches.emplace_back(id, begin, end);
+        return matches.size() < 2;
+    });
+    assert(matches.size() == 2);
+
+    // A single regex is pattern 0.
+    const regex::pattern single("(ab|c)*de");
+    auto num_matches = 0;
+    single.scan("de xcde abd", [&](int id, std::size_t, std::size_t) {
+        assert(id == 0);
+        ++num_matches;
+    });
+    assert(num_matches == 2);
+}
+
+void match_buffers()
+{
+    const regex::pattern re({"ab", "abc|d", "b+"});
+    const auto input = "xabcdabbb abd";
+    std::size_t begins[3];
+    std::size_t ends[3];
+    int ids[3];
+    const regex::match_buffers out{begins, ends, ids, 3};
+
+    regex::continuation token;
+    assert(re.find_all(input, out, token) == 3);
+    assert(!token.is_done);
+    assert(begins[0] == 1 && ends[0] == 4 && ids[0] == 1);
+    assert(begins[2] == 5 && ends[2] == 7 && ids[2] == 0);
+    assert(re.find_all(input, out, token) == 3);
+    assert(begins[0] == 7 && ends[0] == 9 && ids[0] == 2);
+    assert(begins[1] == 10 && ends[1] == 12 && ids[1] == 0);
+    assert(begins[2] == 12 && ends[2] == 13 && ids[2] == 1);
+    assert(re.find_all(input, out, token) == 0);
+    assert(token.is_done);
+
+    // Buffers with room for all matches get them in a single call, which
+    // marks the token done.
+    std::size_t large_begins[16];
+    std::size_t large_ends[16];
+    int large_ids[16];
+    const regex::match_buffers large{large_begins, large_ends, large_ids, 16};
+    regex::continuation token2;
+    assert(re.find_all(input, large, token2) == 6);
+    assert(token2.is_done);
+    assert(large_begins[0] == 1 && large_ends[0] == 4 && large_ids[0] == 1);
+    assert(large_begins[3] == 7 && large_ends[3] == 9 && large_ids[3] == 2);
+    assert(large_begins[5] == 12 && large_ends[5] == 13 && large_ids[5] == 1);
+
+    regex::continuation token3;
+    assert(re.find_all("xxabxx", large, token3) == 1);
+    assert(token3.is_done);
+}
+
+void count_matches()
+{
+    const regex::pattern re("(ab|c)*de");
+    const std::vector<std::string_view> records = {"de", "xabdey", "abd", "", "cdecde"};
+    assert(re.count(records) == 3);
+    assert(re.count_earliest("de xabdey abd cdecde") == 4);
+    assert(re.count_earliest("") == 0);
+    assert(re.count_earliest("abababd") == 0);
+
+    // Matches are counted as soon as they end.
+    assert(regex::pattern("ab+").count_earliest("abbb abb") == 2);
+    assert(regex::pattern("b+").count_earliest("abbb") == 3);
+    std::size_t num_scanned = 0;
+    regex::pattern("b+").scan("abbb", [&](int, std::size_t, std::size_t) { ++num_scanned; });
+    assert(num_scanned == 1);
+    // Patterns matching the empty string count like `scan`.
+    assert(regex::pattern("a*").count_earliest("baab") == 4);
+}
+
+void sorted_batches()
+{
+    const regex::pattern re("https://([a-z.])+/api/([a-z0-9/])*");
+    std::vector<std::string> urls{"https://example.com/api/v1/users", "https://example.com/api/v1/users/42",
+        "https://example.com/api/v2", "https://example.com/static/app.js", "https://example.com/",
+        "https://example.org/api/", "https://example.org/", "https://", "", "ftp://example.com/api/x"};
+    std::sort(urls.begin(), urls.end());
+    std::vector<bool> expected, expected_contains;
+    for(const auto& url : urls) {
+        expected.push_back(re.match(url));
+        expected_contains.push_back(re.contains(url));
+    }
+    assert(re.match_sorted(urls) == expected);
+    assert(re.contains_sorted(urls) == expected_contains);
+    assert(std::count(expected.begin(), expected.end(), true) == 4);
+
+    // Inputs need not be sorted, nor distinct.
+    std::reverse(urls.begin(), urls.end());
+    urls.push_back(urls.back());
+    std::reverse(expected.begin(), expected.end());
+    expected.push_back(expected.back());
+    assert(re.match_sorted(urls) == expected);
+
+    // Inputs are only stepped up to a terminal state.
+    const auto prefix = fsm::frozen_dfa::combine({regex::compile("ab")}, fsm::match_mode::prefix);
+    fsm::prefix_matcher matcher(prefix);
+    assert(matcher.simulate_prefix("a") == fsm::result::partial);
+    assert(matcher.simulate_prefix("abc") == fsm::result::accept);
+    assert(matcher.simulate_prefix("abd") == fsm::result::accept);
+    assert(matcher.simulate_prefix("ac") == fsm::result::reject);
+    matcher.reset();
+    assert(matcher.simulate("ab") == fsm::result::accept);
+}
+
+void cached_matches()
+{
+    const regex::pattern agent_pattern("Mozilla/5.0 \\([XW]([^)])*\\)(.)*");
+    cache::cached_pattern re(agent_pattern, {/*capacity=*/ 64, /*num_shards=*/ 4, /*max_input_size=*/ 64});
+    const std::vector<std::string> agents{"Mozilla/5.0 (X11; Linux x86_64) Firefox/118.0",
+        "Mozilla/5.0 (Windows NT 10.0; Win64; x64)", "curl/8.4.0", "Mozilla/5.0 (Macintosh)", ""};
+    for(auto round = 0; round < 3; ++round) {
+        for(const auto& agent : agents) {
+            assert(re.match(agent) == re.pattern().match(agent));
+            assert(re.contains(agent) == re.pattern().contains(agent));
+        }
+    }
+    auto stats = re.stats();
+    assert(stats.hits + stats.misses == 30 && stats.bypasses == 0);
+    assert(stats.hits > 0 && stats.hit_ratio() > 0.5);
+
+    // Long inputs aren't cached.
+    const std::string long_agent = "Mozilla/5.0 (X11)" + std::string(100, 'x');
+    assert(re.match(long_agent) && re.match(long_agent));
+    assert(re.stats().bypasses == 2);
+
+    re.clear();
+    assert(re.stats().hits == 0 && re.stats().hit_ratio() == 0);
+
+    // Inputs evicting each other from a full cache still match correctly.
+    cache::cached_pattern small(agent_pattern, {/*capacity=*/ 4, /*num_shards=*/ 2});
+    for(auto i = 0; i < 1000; ++i) {
+        const auto agent = "Mozilla/5.0 (X11; rv:" + std::to_string(i % 50) + ")";
+        assert(small.match(agent) && !small.match("x" + agent));
+    }
+    assert(small.stats().hits + small.stats().misses == 2000);
+
+    // The capacity is never exceeded, even if it's smaller than twice the
+    // number of shards.
+    assert(small.capacity() == 4);
+    assert(re.capacity() == 64);
+    assert(cache::cached_pattern(agent_pattern, {/*capacity=*/ 2, /*num_shards=*/ 16}).capacity() == 2);
+    assert(cache::cached_pattern(agent_pattern, {/*capacity=*/ 5, /*num_shards=*/ 16}).capacity() == 4);
+    assert(cache::cached_pattern(agent_pattern, {/*capacity=*/ 100, /*num_shards=*/ 16}).capacity() == 96);
+
+    // Concurrent lookups.
+    std::vector<std::thread> threads;
+    std::atomic<int> num_wrong{0};
+    for(auto t = 0; t < 4; ++t) {
+        threads.emplace_back([&] {
+            for(auto i = 0; i < 2000; ++i) {
+                const auto& agent = agents[i % agents.size()];
+                num_wrong += re.match(agent) != re.pattern().match(agent);
+            }
+        });
+    }
+    for(auto& thread : threads) {
+        thread.join();
+    }
+    assert(num_wrong == 0);
+    stats = re.stats();
+    assert(stats.hits + stats.misses == 8000 && stats.hit_ratio() > 0.9);
+
+    assert(cache::hash("abc") == cache::hash(std::string("abc")));
+    assert(cache::hash("abcdefgh1") != cache::hash("abcdefgh2"));
+    assert(cache::hash("") != cache::hash(std::string_view("\0", 1)));
+}
+
+void split_fields()
+{
+    using fields_type = std::vector<std::string_view>;
+    const auto split = [](const regex::pattern& re, std::string_view input) {
+        fields_type result;
+        for(const auto field : split::fields(re, input)) {
+            result.push_back(field);
+        }
+        return result;
+    };
+
+    const regex::pattern comma(",");
+    assert((split(comma, "a,b,,c") == fields_type{"a", "b", "", "c"}));
+    assert((split(comma, ",a,") == fields_type{"", "a", ""}));
+    assert((split(comma, "") == fields_type{""}));
+
+    const regex::pattern spaces(" +");
+    const std::string_view line = "GET  /index.html   200";
+    const auto fields = split(spaces, line);
+    assert((fields == fields_type{"GET", "/index.html", "200"}));
+    // Fields point into the original buffer.
+    assert(fields[1].data() == line.data() + 5);
+
+    // Empty delimiter matches don't split.
+    assert((split(regex::pattern("x*"), "axxbc") == fields_type{"a", "bc"}));
+
+    const regex::pattern re("(ab|c)*de");
+    fields_type tokens;
+    for(const auto token : split::tokens(re, "de xabdey abd cde")) {
+        tokens.push_back(token);
+    }
+    assert((tokens == fields_type{"de", "abde", "cde"}));
+}
+
+void replace_matches()
+{
+    const regex::pattern re("(ab|c)*de");
+    assert(replace::replace_all(re, "de xabdey abd cde", "<>") == "<> x<>y abd <>");
+    assert(replace::replace_all(re, "no match", "<>") == "no match");
+    assert(replace::replace_all(re, "", "<>") == "");
+    assert(replace::replace_all(re, "cdeabde", "") == "");
+    assert(replace::replace_all(regex::pattern("a*"), "baab", "-") == "-b--b-");
+
+    replace::replacer r;
+    char out[8];
+    assert(r.replace_all(re, "xxabdexx", "[redacted]", out, sizeof(out)) == 14);
+    assert(r.num_matches() == 1);
+    assert(r.replace_all(re, "xxabdexx", "*", out, sizeof(out)) == 5);
+    assert(std::string_view(out, 5) == "xx*xx");
+
+    // A too small buffer can be retried without rescanning.
+    std::string large(r.prepare(re, "abde-cde", "[redacted]"), '\0');
+    r.write(large.data());
+    assert(large == "[redacted]-[redacted]");
+}
+
+void unicode_classes()
+{
+    const auto any = regex::compile("x.y");
+    assert(any.simulate("xay") == fsm::result::accept);
+    assert(any.simulate("x\u00e9y") == fsm::result::accept);
+    assert(any.simulate("x\u20acy") == fsm::result::accept);
+    assert(any.simulate("x\U0001f600y") == fsm::result::accept);
+    assert(any.simulate("x\ny") == fsm::result::reject);
+    // Only valid UTF-8 matches: a lone continuation byte, an overlong
+    // encoding and an encoded surrogate.
+    assert(any.simulate("x\x80y") == fsm::result::reject);
+    assert(any.simulate("x\xc0\xafy") == fsm::result::reject);
+    assert(any.simulate("x\xed\xa0\x80y") == fsm::result::reject);
+    // Continuation bytes are shared, so the DFA stays small.
+    assert(any.size() < 16);
+    // The bytes of a range share their NFA states, so the NFA stays small
+    // too, even with many classes in a row.
+    assert(utf8::build_any().size() < 128);
+    const auto dots = regex::compile("............");
+    assert(dots.simulate("abcdefghijk\u20ac") == fsm::result::accept);
+    assert(dots.simulate("abcdefghijk") == fsm::result::reject);
+
+    // NUL can't be matched, so patterns that name it are rejected, and
+    // negated classes don't match it.
+    for(const auto pattern : {std::string_view("[\0-a]", 5), std::string_view("\\\0", 2)}) {
+        bool is_rejected = false;
+        try {
+            regex::compile(pattern);
+        } catch(const std::invalid_argument&) {
+            is_rejected = true;
+        }
+        assert(is_rejected);
+    }
+    assert(regex::compile("[^a]").simulate(std::string_view("\0", 1)) == fsm::result::reject);
+
+    const auto greek = regex::compile("[\u03b1-\u03c9]+");
+    assert(greek.simulate("\u03b1\u03b2\u03c9") == fsm::result::accept);
+    assert(greek.simulate("\u03b1\u0391") == fsm::result::reject);
+
+    const auto not_vowel = regex::compile("[^aeiou\u00e4]");
+    assert(not_vowel.simulate("b") == fsm::result::accept);
+    assert(not_vowel.simulate("\u00f6") == fsm::result::accept);
+    assert(not_vowel.simulate("\U0010ffff") == fsm::result::accept);
+    assert(not_vowel.simulate("e") == fsm::result::reject);
+    assert(not_vowel.simulate("\u00e4") == fsm::result::reject);
+
+    assert(regex::compile("a\\.b").simulate("a.b") == fsm::result::accept);
+    assert(regex::compile("a\\.b").simulate("axb") == fsm::result::reject);
+    assert(regex::compile("[\\]\\-]").simulate("]") == fsm::result::accept);
+    assert(regex::compile("[\\]\\-]").simulate("-") == fsm::result::accept);
+
+    // Each code point in a range splits into byte sequences of the right
+    // length; check ranges that cross encoding lengths against a decoder.
+    const auto mixed = regex::compile("[\u0070-\u0800\ud7f0-\U00010010]");
+    for(const char32_t cp : {0x6f, 0x70, 0x7f, 0x80, 0x7ff, 0x800, 0x801, 0xd7ef, 0xd7f0,
+            0xd7ff, 0xe000, 0xffff, 0x10000, 0x10010, 0x10011}) {
+        unsigned char bytes[4];
+        const auto size = utf8::encode(cp, bytes);
+        const std::string_view encoded(reinterpret_cast<const char*>(bytes), size);
+        const bool is_in_class = (cp >= 0x70 && cp <= 0x800) || (cp >= 0xd7f0 && cp <= 0x10010);
+        assert((mixed.simulate(encoded) == fsm::result::accept) == is_in_class);
+    }
+
+    const regex::pattern word("[a-z\u00df-\u00ff]+");
+    const auto match = word.find("  gr\u00fc\u00dfe! ");
+    assert(match && match->begin == 2 && match->end == 9);
+}
+
+void validate_utf8()
+{
+    const std::string valid = "a\u00e9\u20ac\U0001f600" + std::string(40, 'x') + "\u00e9";
+    utf8::validator v;
+    for(const auto c : valid) {
+        assert(v.feed(std::string_view(&c, 1)));
+    }
+    assert(v.finish() && !v.error_offset());
+
+    assert(!utf8::find_invalid(valid));
+    assert(utf8::find_invalid("ab\xc3(") == 2);
+    assert(utf8::find_invalid("\xed\xa0\x80") == 0);
+    assert(utf8::find_invalid("\xf4\x90\x80\x80") == 0);
+    assert(utf8::find_invalid("ab\xe2\x82") == 2);
+    // Errors past whole blocks of valid input, including one in a sequence
+    // that straddles two blocks.
+    assert(utf8::find_invalid(std::string(37, 'x') + "\u00e9\x80") == 39);
+    assert(utf8::find_invalid(std::string(15, 'x') + "\xe2\x82x") == 15);
+    assert(utf8::find_invalid(valid + "\xff" + valid) == valid.size());
+
+    const auto dfa = regex::compile("[a-z\u00e0-\u00ff]+");
+    utf8::validating_matcher matcher(dfa, 3);
+    assert(matcher.feed("gr\u00fcn"));
+    assert(matcher.finish() == fsm::result::accept);
+    matcher.reset();
+    assert(!matcher.feed("gr\xfcn"));
+    assert(matcher.finish() == fsm::result::reject && matcher.error_offset() == 2);
+
+    const auto path = "degenerexp_utf8_test.txt";
+    for(const auto backend : {scanner::backend::mmap, scanner::backend::io_uring}) {
+        scanner::options opts;
+        opts.backend = backend;
+        opts.buffer_size = 5;
+        std::ofstream(path, std::ios::binary | std::ios::trunc) << "\u00e4\u00f6\u00fc\u00e4\u00f6\u00fc";
+        auto result = scanner::scan_file_utf8(dfa, path, opts);
+        assert(result.result == fsm::result::accept && !result.invalid_offset);
+        std::ofstream(path, std::ios::binary | std::ios::trunc) << "\u00e4\u00f6\u00fc\u00e4\xf6\u00fc";
+        result = scanner::scan_file_utf8(dfa, path, opts);
+        assert(result.result == fsm::result::reject && result.invalid_offset == 8);
+    }
+    std::remove(path);
+
+    const std::vector<std::string> records{"abc", "\u00e4b", "a\xc3", "\x80"};
+    pipeline::options opts;
+    opts.validate_utf8 = true;
+    std::size_t next = 0;
+    std::vector<pipeline::match_record> results(records.size());
+    pipeline::run(dfa, opts,
+        [&](char* data, std::size_t) -> std::size_t {
+            if(next == records.size()) { return 0; }
+            const auto& record = records[next++];
+            std::copy(record.begin(), record.end(), data);
+            return record.size();
+        },
+        [&](const pipeline::match_record& record) { results[record.sequence] = record; });
+    assert(results[0].result == fsm::result::accept && !results[0].invalid_utf8_offset);
+    assert(results[1].result == fsm::result::accept && !results[1].invalid_utf8_offset);
+    assert(results[2].result == fsm::result::reject && results[2].invalid_utf8_offset == 1);
+    assert(results[3].result == fsm::result::reject && results[3].invalid_utf8_offset == 0);
+}
+
+void symbolic_automata()
+{
+    // Event ids: a login, followed by anything but a logout, followed by one
+    // of a hundred purchase events.
+    constexpr symbolic::symbol_t login = 100000;
+    constexpr symbolic::symbol_t logout = 100001;
+    const auto not_logout = symbolic::interval_set{{logout, logout}}.complement();
+    assert(!not_logout.contains(logout) && not_logout.contains(login));
+    assert(not_logout.contains(symbolic::min_symbol) && not_logout.contains(symbolic::max_symbol));
+
+    const auto nfa = symbolic::build_concatenation(
+        symbolic::build_concatenation(symbolic::build_symbol(login),
+            symbolic::build_kleene_star(symbolic::build_symbols(not_logout))),
+        symbolic::build_symbols({{2000000, 2000099}}));
+    const symbolic::dfa dfa(nfa);
+    // Login, logout, purchases and everything else.
+    assert(dfa.num_classes() == 4);
+
+    using events = std::vector<symbolic::symbol_t>;
+    assert(dfa.simulate(events{login, 2000000}) == fsm::result::accept);
+    assert(dfa.simulate(events{login, -5, login, 2000050, 2000099}) == fsm::result::accept);
+    assert(dfa.simulate(events{login, logout, 2000000}) == fsm::result::reject);
+    assert(dfa.simulate(events{login, 2000100}) == fsm::result::reject);
+    assert(dfa.simulate(events{}) == fsm::result::reject);
+    assert(dfa.longest_prefix(events{login, 2000000, 7, 2000001, logout, 2000002}) == 4);
+    assert(!dfa.longest_prefix(events{logout, login, 2000000}));
+
+    // Overlapping intervals are split where they overlap.
+    const symbolic::dfa overlapping(symbolic::build_alternation(
+        symbolic::build_concatenation(symbolic::build_symbols({{0, 99}}), symbolic::build_symbol(1)),
+        symbolic::build_concatenation(symbolic::build_symbols({{50, 149}}), symbolic::build_symbol(2))));
+    assert(overlapping.simulate(events{10, 1}) == fsm::result::accept);
+    assert(overlapping.simulate(events{70, 1}) == fsm::result::accept);
+    assert(overlapping.simulate(events{70, 2}) == fsm::result::accept);
+    assert(overlapping.simulate(events{120, 2}) == fsm::result::accept);
+    assert(overlapping.simulate(events{120, 1}) == fsm::result::reject);
+    assert(overlapping.simulate(events{10, 2}) == fsm::result::reject);
+}
+
+void packed_nucleotides()
+{
+    const std::string sequence = "ACGTTGCAAC" "GATTACA" "GGCCTTAA";
+    const auto packed = dna::pack(sequence);
+    assert(packed.size() == 7);
+    assert(packed[0] == 0x1b);
+    assert(dna::unpack(packed.data(), sequence.size()) == sequence);
+
+    const auto motif = regex::compile("GATTACA|GATTAGA");
+    const dna::dfa full(motif);
+    assert(full.simulate(dna::pack("GATTACA"), 7) == fsm::result::accept);
+    assert(full.simulate(dna::pack("GATTAGA"), 7) == fsm::result::accept);
+    assert(full.simulate(dna::pack("GATTATA"), 7) == fsm::result::reject);
+
+    const dna::dfa search(fsm::frozen_dfa::combine({motif}, fsm::match_mode::search));
+    // Every length, so that the motif ends both at and between byte
+    // boundaries, and is cut off by the last, partial byte.
+    for(std::size_t n = 0; n <= sequence.size(); ++n) {
+        const auto expected = sequence.substr(0, n).find("GATTACA") != std::string::npos;
+        assert((search.simulate(packed, n) == fsm::result::accept) == expected);
+    }
+    assert(search.classify(search.step(search.start_state(), packed.data(), 12)) == fsm::result::partial);
+
+    // A motif that can't be matched by bases alone is dead from the start.
+    const dna::dfa impossible(fsm::frozen_dfa::combine({regex::compile("GAXA")}, fsm::match_mode::search));
+    assert(impossible.classify(impossible.start_state()) == fsm::result::reject);
+
+    const auto path = "degenerexp_dna_test.bin";
+    std::ofstream(path, std::ios::binary | std::ios::trunc)
+        .write(reinterpret_cast<const char*>(packed.data()), packed.size());
+    for(const auto backend : {scanner::backend::mmap, scanner::backend::io_uring}) {
+        scanner::options opts;
+        opts.backend = backend;
+        opts.buffer_size = 2;
+        assert(dna::scan_file(search, path, sequence.size(), opts) == fsm::result::accept);
+        assert(dna::scan_file(search, path, 15, opts) == fsm::result::reject);
+    }
+    std::remove(path);
+}
+
+void approximate_matches()
+{
+    const approximate::matcher name("keyboard", 2, fsm::match_mode::full);
+    assert(name.find("keyboard")->errors == 0);
+    assert(name.find("keybaord")->errors == 2);
+    assert(name.find("kyboard")->errors == 1);
+    assert(name.find("keyboards")->errors == 1);
+    assert(!name.find("kebaord"));
+
+    const approximate::matcher search("(ab|c)*de", 1);
+    const auto match = search.find("xxabcxdeyy");
+    assert(match && match->end == 7 && match->errors == 1);
+    assert(search.simulate("zzz") == fsm::result::reject);
+    assert(approximate::matcher("(ab|c)*de", 0).find("xxabcxdeyy")->end == 8);
+
+    // A class takes a single position rather than one per byte.
+    const approximate::matcher code("[A-Z][A-Z][0-9][0-9].", 1, fsm::match_mode::full);
+    assert(code.find("AB12x")->errors == 0);
+    assert(code.find("AB12\u00e9")->errors == 0);
+    assert(code.find("A812x")->errors == 1);
+    assert(code.find("AB12")->errors == 1);
+    assert(!code.find("a812"));
+
+    const auto dfa = approximate::levenshtein_dfa("keyboard", 1);
+    assert(dfa.simulate("keyboard") == fsm::result::accept);
+    assert(dfa.simulate("keybard") == fsm::result::accept);
+    assert(dfa.simulate("keyb0ard") == fsm::result::accept);
+    assert(dfa.simulate("keybaord") == fsm::result::reject);
+    for(const auto word : {"", "a", "keybaord", "keyboardd", "eyboar", "xkeyboard"}) {
+        const auto expected = name.find(word) && name.find(word)->errors <= 1;
+        assert((dfa.simulate(word) == fsm::result::accept) == expected);
+    }
+}
+
+void dictionary_queries()
+{
+    std::vector<std::string> terms{"keyboard", "keyboards", "key", "monitor", "mouse",
+        "mousepad", "keys", "keypad", "cable", "key"};
+    for(auto i = 0; i < 1000; ++i) {
+        terms.push_back("sku" + std::to_string(i));
+    }
+    const dictionary::trie trie(terms);
+    assert(trie.size() == terms.size() - 1);
+    assert(trie.term(0) == "cable");
+
+    using terms_type = std::vector<std::string_view>;
+    assert((trie.matches(regex::compile("key(s|pad)?")) == terms_type{"key", "keypad", "keys"}));
+    assert((trie.matches(regex::compile("[a-z]+ble|mouse")) == terms_type{"cable", "mouse"}));
+    assert((trie.matches(regex::compile("sku12.")) == terms_type{"sku120", "sku121", "sku122",
+        "sku123", "sku124", "sku125", "sku126", "sku127", "sku128", "sku129"}));
+
+    // The walk is pruned as soon as the DFA dies, so queries don't touch
+    // most of the dictionary.
+    std::size_t num_matches = 0;
+    const auto num_visited = trie.query(regex::compile("keyboard|keyboards"),
+        [&num_matches](dictionary::term_id, std::string_view) { ++num_matches; });
+    assert(num_matches == 2 && num_visited < 20);
+
+    const auto prefix = fsm::frozen_dfa::combine({regex::compile("mou")}, fsm::match_mode::prefix);
+    assert((trie.matches(prefix) == terms_type{"mouse", "mousepad"}));
+    const auto fuzzy = approximate::levenshtein_dfa("keybord", 1);
+    assert((trie.matches(fuzzy) == terms_type{"keyboard"}));
+
+    std::vector<std::string_view> first_two;
+    trie.query(regex::compile("sku1(1)*"), [&first_two](dictionary::term_id, std::string_view term) {
+        first_two.push_back(term);
+        return first_two.size() < 2;
+    });
+    assert((first_two == terms_type{"sku1", "sku11"}));
+}
+
+void trigram_search()
+{
+    using trigrams_type = std::vector<trigram::trigram_t>;
+    const auto t = [](const char* s) { return trigram::make_trigram(s[0], s[1], s[2]); };
+    assert((trigram::derive_query("hello").any_of == std::vector<trigrams_type>{{t("ell"), t("hel"), t("llo")}}));
+    // Alternatives that share no trigrams are split into conjunctions.
+    assert((trigram::derive_query("abcd|xyz").any_of
+        == std::vector<trigrams_type>{{t("abc"), t("bcd")}, {t("xyz")}}));
+    // Only the trigrams no match can avoid are required.
+    assert((trigram::derive_query("[a-z]*error(s)*").any_of
+        == std::vector<trigrams_type>{{t("err"), t("ror"), t("rro")}}));
+    assert(trigram::derive_query("ab|cde").matches_all());
+    assert(trigram::derive_query(".*").matches_all());
+
+    const std::vector<std::string> documents{
+        "the quick brown fox", "jumps over the lazy dog", "hello world", "say hello",
+        "abcd", "xyz", "no errors here", "error 404", "helo"};
+    trigram::memory_index index;
+    for(const auto& d : documents) {
+        index.add(d);
+    }
+    assert(index.num_documents() == documents.size());
+
+    std::vector<trigram::doc_id> fetched;
+    const auto get_document = [&](const trigram::doc_id id) {
+        fetched.push_back(id);
+        return std::string_view(documents[id]);
+    };
+    using ids_type = std::vector<trigram::doc_id>;
+    assert((trigram::search(index, "hello", get_document) == ids_type{2, 3}));
+    // Only the candidates are matched.
+    assert((fetched == ids_type{2, 3}));
+    assert((trigram::search(index, "abcd|xyz", get_document) == ids_type{4, 5}));
+    assert((trigram::search(index, "error(s)* [0-9]+", get_document) == ids_type{7}));
+    fetched.clear();
+    assert((trigram::search(index, "zebra", get_document).empty() && fetched.empty()));
+    // Without required trigrams every document is a candidate.
+    assert((trigram::search(index, "[df]o", get_document) == ids_type{0, 1}));
+    assert(fetched.size() == documents.size());
+
+    // Candidates are a superset of the matches for random patterns.
+    const std::vector<std::string> regexes{"qu[ia]ck", "[lc]azy", "he(l)*o", "[a-h]ello", "err..",
+        "o[vw]er", "(x|y)(y|z)*"};
+    for(const auto& r : regexes) {
+        const auto dfa = fsm::frozen_dfa::combine({regex::compile(r)}, fsm::match_mode::search);
+        const auto ids = trigram::candidates(index, trigram::derive_query(r));
+        for(trigram::doc_id id = 0; id < documents.size(); ++id) {
+            if(dfa.simulate(documents[id]) == fsm::result::accept) {
+                assert(std::binary_search(ids.begin(), ids.end(), id));
+            }
+        }
+    }
+}
+
+void filter_column()
+{
+    const std::vector<std::string> dictionary{"GET /index.html", "POST /api/login", "GET /api/users",
+        "DELETE /api/users/7", "GET /favicon.ico"};
+    const auto dfa = regex::compile("GET /api/(.)*");
+
+    const auto selection = column::match_dictionary(dfa, dictionary);
+    assert(selection.size() == dictionary.size() && selection.count() == 1 && selection.test(2));
+
+    // Enough rows for the vectorized loop and a remainder.
+    std::vector<column::code_t> codes;
+    for(auto i = 0; i < 1000; ++i) {
+        codes.push_back((i * 7 + i / 3) % dictionary.size());
+    }
+    const auto rows = column::filter(fsm::frozen_dfa::combine({dfa}, fsm::match_mode::prefix), dictionary, codes);
+    assert(rows.size() == codes.size());
+    std::size_t num_selected = 0;
+    for(std::size_t i = 0; i < codes.size(); ++i) {
+        assert(rows.test(i) == (codes[i] == 2));
+        num_selected += codes[i] == 2;
+    }
+    assert(rows.count() == num_selected && num_selected > 0);
+
+    // Dictionaries larger than a word of the bitmap.
+    column::bitmap large(100);
+    for(column::code_t code = 0; code < large.size(); code += 3) {
+        large.set(code);
+    }
+    std::vector<column::code_t> large_codes(200);
+    for(std::size_t i = 0; i < large_codes.size(); ++i) {
+        large_codes[i] = (i * 37) % large.size();
+    }
+    const auto large_rows = column::select(large, large_codes);
+    for(std::size_t i = 0; i < large_codes.size(); ++i) {
+        assert(large_rows.test(i) == (large_codes[i] % 3 == 0));
+    }
+    assert(column::select(large, {}).size() == 0);
+}
+
+void lex()
+{
+    enum { kw_if, ident, num, ws, eq, eqeq };
+    const lexer::lexer lex({
+        {kw_if, "if"},
+        {ident, "(a|b|f|i|x)+"},
+        {num, "(0|1|2)+"},
+        {ws, " +"},
+        {eq, "="},
+        {eqeq, "=="},
+    });
+
+    const std::string_view input = "if x == 12 ifx=b";
+    std::vector<std::pair<int, std::string_view>> tokens;
+    const auto end = lex.tokenize(input, [&](const lexer::token& t) {
+        tokens.emplace_back(t.id, input.substr(t.span.begin, t.span.size()));
+    });
+    assert(end == input.size());
+    assert((tokens == std::vector<std::pair<int, std::string_view>>{
+        {kw_if, "if"}, {ws, " "}, {ident, "x"}, {ws, " "}, {eqeq, "=="}, {ws, " "},
+        {num, "12"}, {ws, " "}, {ident, "ifx"}, {eq, "="}, {ident, "b"}}));
+
+    // Lexing stops where no rule matches.
+    assert(lex.tokenize("if ?", [](const lexer::token&) {}) == 3);
+    assert(!lex.next("?", 0));
+}
+
+void transduce()
+{
+    using transducer::action;
+
+    // Drops carriage returns and upper-cases 'a' and 'b'.
+    transducer::transducer normalize;
+    normalize.set_transition(0, '\r', 0, action::drop());
+    normalize.set_transition(0, 'a', 0, action::emit_byte('A'));
+    normalize.set_transition(0, 'b', 0, action::emit_byte('B'));
+    assert(normalize.apply("ab\r\ncd") == "AB\ncd");
+
+    // Unescapes "\\n" and "\\\\", keeping other escapes as they are.
+    transducer::transducer unescape;
+    const auto escaped = unescape.add_state();
+    unescape.set_transition(0, '\\', escaped, action::drop());
+    unescape.set_transitions(escaped, 0, action::copy_input());
+    unescape.set_transition(escaped, 'n', 0, action::emit_byte('\n'));
+    for(auto c = 0; c < 256; ++c) {
+        if(c != 'n' && c != '\\') {
+            unescape.set_transition(escaped, c, 0, action::emit_string(std::string{'\\', char(c)}));
+        }
+    }
+    unescape.set_final_output(escaped, "\\");
+    assert(unescape.apply("a\\nb\\\\c\\x\\") == "a\nb\\c\\x\\");
+
+    const auto both = transducer::transducer::compose(normalize, unescape);
+    for(const auto input : {"", "a\\nb\r\\\\c", "\\\r\\", "\\a", "xyz\\"}) {
+        assert(both.apply(input) == unescape.apply(normalize.apply(input)));
+    }
+
+    // Streaming in pieces yields the same output.
+    std::string output;
+    const auto append = [&output](std::string_view s) { output += s; };
+    auto s = both.feed(transducer::transducer::start_state, "ab\\", append);
+    s = both.feed(s, "nc\r\\", append);
+    both.finish(s, append);
+    assert(output == both.apply("ab\\nc\r\\"));
+
+    // Drops the spaces outside of quotes, following a DFA whose accepting
+    // states are those outside of quotes.
+    const auto quotes = regex::compile("(([^\"])*\"([^\"])*\")*([^\"])*");
+    const auto squeeze = transducer::transducer::from_dfa(quotes,
+        [&quotes](fsm::state_t from, unsigned char c, fsm::state_t) {
+            return quotes.is_accepting(from) && c == ' ' ? action::drop() : action::copy_input();
+        });
+    assert(squeeze.apply("a b \"c d\" e") == "ab\"c d\"e");
+    assert(squeeze.apply("\" \"") == "\" \"");
+    assert(transducer::transducer::state_of(quotes, quotes.start_state())
+        == transducer::transducer::start_state);
+
+    // Many transitions share the same outputs.
+    transducer::transducer lower;
+    for(auto c = 'A'; c <= 'Z'; ++c) {
+        lower.set_transition(0, c, 0, action::emit_byte(c - 'A' + 'a'));
+        lower.set_transition(0, c - 'A' + 'a', 0, action::emit_byte(c - 'A' + 'a'));
+    }
+    assert(lower.apply("Hello World") == "hello world");
+}
+
+void multiplexed_streams()
+{
+    const auto nfa = parser::shunting_yard_nfa_parser("(ab|c)*de").parse();
+    const fsm::frozen_dfa dfa(fsm::dfa(nfa, fsm::derive_input_language("abcde")));
+
+    scheduler::scheduler sched(dfa, 4);
+    const auto big = sched.open();
+    const auto small = sched.open();
+    const auto rejected = sched.open();
+
+    std::string payload;
+    for(auto i = 0; i < 100; ++i) {
+        payload += "ab";
+    }
+    sched.submit(big, payload);
+    sched.submit(big, "de");
+    sched.submit(small, "cd");
+    sched.submit(small, "e");
+    sched.submit(rejected, "x");
+
+    std::vector<std::pair<scheduler::stream_id, fsm::result>> events;
+    const auto on_scanned = [&](scheduler::stream_id id, std::string_view, fsm::result r) {
+        events.emplace_back(id, r);
+    };
+
+    // The small streams are done within the first round despite the big
+    // payload submitted before them.
+    assert(sched.run(8, on_scanned) == 4 + 3 + 1);
+    assert((events == std::vector<std::pair<scheduler::stream_id, fsm::result>>{
+        {small, fsm::result::partial},
+        {small, fsm::result::accept},
+        {rejected, fsm::result::reject}}));
+    assert(sched.status(big) == fsm::result::partial);
+
+    while(sched.has_pending()) {
+        sched.run(1000, on_scanned);
+    }
+    assert(events.size() == 5);
+    assert(events[3] == std::make_pair(big, fsm::result::partial));
+    assert(events[4] == std::make_pair(big, fsm::result::accept));
+
+    sched.close(small);
+    assert(sched.open() == small);
+    assert(sched.status(small) == fsm::result::partial);
+
+    // Streams may be closed and opened from within the callback, such as
+    // a stream that is done once it has been scanned, even if it has more
+    // data pending.
+    scheduler::scheduler callback_sched(dfa, 2);
+    const auto first = callback_sched.open();
+    const auto second = callback_sched.open();
+    callback_sched.submit(first, "de");
+    callback_sched.submit(first, "never scanned");
+    callback_sched.submit(second, "ab");
+    callback_sched.submit(second, "de");
+    std::vector<scheduler::stream_id> opened;
+    std::vector<std::pair<scheduler::stream_id, std::string_view>> scanned;
+    callback_sched.run(1000, [&](scheduler::stream_id id, std::string_view data, fsm::result r) {
+        scanned.emplace_back(id, data);
+        if(r == fsm::result::accept) {
+            callback_sched.close(id);
+        }
+        if(id == second && data == "ab") {
+            // Reallocates the streams, and reuses the first stream's id.
+            for(auto i = 0; i < 16; ++i) {
+                opened.push_back(callback_sched.open());
+            }
+            callback_sched.submit(opened.front(), "cde");
+        }
+    });
+    assert(!callback_sched.has_pending());
+    assert(opened.front() == first);
+    assert((scanned == std::vector<std::pair<scheduler::stream_id, std::string_view>>{
+        {first, "de"}, {second, "ab"}, {second, "de"}, {first, "cde"}}));
+
+    // Closed streams are skipped, even if their id has been reused since.
+    scheduler::scheduler reuse_sched(dfa);
+    const auto closed = reuse_sched.open();
+    const auto kept = reuse_sched.open();
+    reuse_sched.submit(closed, "ab");
+    reuse_sched.submit(kept, "cd");
+    reuse_sched.close(closed);
+    const auto reopened = reuse_sched.open();
+    assert(reopened == closed);
+    reuse_sched.submit(reopened, "c");
+    std::vector<std::pair<scheduler::stream_id, std::string_view>> reused;
+    reuse_sched.run(1000, [&](scheduler::stream_id id, std::string_view data, fsm::result) {
+        reused.emplace_back(id, data);
+    });
+    assert((reused == std::vector<std::pair<scheduler::stream_id, std::string_view>>{
+        {kept, "cd"}, {reopened, "c"}}));
+    reuse_sched.submit(kept, "e");
+    reuse_sched.close(kept);
+    assert(!reuse_sched.has_pending());
+    assert(reuse_sched.run(1000, [](scheduler::stream_id, std::string_view, fsm::result) {}) == 0);
+}
+
+#ifdef __cpp_impl_coroutine
+void match_generator()
+{
+    const regex::pattern re("(ab|c)*de");
+    const auto input = "de abde xx cccde abd";
+    std::vector<regex::span> spans;
+    for(const auto match : re.matches(input)) {
+        spans.push_back(match);
+    }
+    assert((spans == std::vector<regex::span>{{0, 2}, {3, 7}, {11, 16}}));
+
+    // Stopping early.
+    for(const auto match : re.matches(input)) {
+        assert(match == (regex::span{0, 2}));
+        break;
+    }
+
+    // Empty matches don't get stuck.
+    const regex::pattern star("a*");
+    spans.clear();
+    for(const auto match : star.matches("baab")) {
+        spans.push_back(match);
+    }
+    assert((spans == std::vector<regex::span>{{0, 0}, {1, 3}, {3, 3}, {4, 4}}));
+}
+#endif
+
 int main()
 {
     nfa();
@@ -311,4 +1399,31 @@ int main()
     parse();
     eps_closure();
     dfa();
+    frozen_dfa();
+    match_modes();
+    stream_state();
+    scan_file();
+    run_pipeline();
+    segmented_input();
+    match_callback();
+    match_buffers();
+    count_matches();
+    sorted_batches();
+    cached_matches();
+    split_fields();
+    replace_matches();
+    unicode_classes();
+    validate_utf8();
+    symbolic_automata();
+    packed_nucleotides();
+    approximate_matches();
+    dictionary_queries();
+    trigram_search();
+    filter_column();
+    lex();
+    transduce();
+    multiplexed_streams();
+#ifdef __cpp_impl_coroutine
+    match_generator();
+#endif
 }